@@ -46,7 +46,8 @@ if __name__ == '__main__':
     print('/* bootstrap nodes generated by', __file__)
     print(' * last generated', datetime.datetime.now().isoformat(), '*/')
 
-    print('static struct t_twc_bootstrap_node const twc_bootstrap_nodes[] = {')
+    print('static struct t_twc_bootstrap_node const '
+          'twc_bootstrap_builtin_nodes[] = {')
     for key, address, port, comment in zip(keys, addresses, ports, comments):
         print('    /* {} */'.format(comment))
         print('    {{"{}",'.format(key))
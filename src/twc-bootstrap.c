@@ -17,22 +17,51 @@
  * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <tox/tox.h>
+#include <weechat/weechat-plugin.h>
 
+#include "twc-config.h"
+#include "twc-json.h"
+#include "twc-list.h"
+#include "twc-profile.h"
+#include "twc-span.h"
+#include "twc-stats.h"
 #include "twc-utils.h"
+#include "twc.h"
 
 #include "twc-bootstrap.h"
 
+/* time to wait for a connection before a bootstrap attempt is considered
+ * failed and retried, in microseconds; doubled for every failed attempt */
+#define TWC_BOOTSTRAP_TIMEOUT (10 * 1000000)
+#define TWC_BOOTSTRAP_MAX_TIMEOUT (5 * 60 * 1000000LL)
+
+/* cached nodes that failed this many more times than they succeeded are
+ * dropped */
+#define TWC_BOOTSTRAP_CACHE_MAX_FAILURES (3)
+
+/* cached nodes that have not worked for this long (in seconds) are dropped */
+#define TWC_BOOTSTRAP_CACHE_MAX_AGE (30 * 24 * 60 * 60)
+
+/* maximum number of nodes saved to a profile's node cache */
+#define TWC_BOOTSTRAP_CACHE_MAX_SIZE (32)
+
 struct t_twc_bootstrap_node
 {
-    char const *const key;
-    char const *const address;
-    uint16_t const port;
+    char *key;
+    char *address;
+    uint16_t port;
 };
 
-/* bootstrap nodes generated by misc/getnodes.py
+/* built-in bootstrap nodes, used when no node file is available
+ * generated by misc/getnodes.py
  * last generated 2018-04-12T22:40:44.123211 */
-static struct t_twc_bootstrap_node const twc_bootstrap_nodes[] = {
+static struct t_twc_bootstrap_node const twc_bootstrap_builtin_nodes[] = {
     /* Maintainer: Manolis, location: DE */
     {"461FA3776EF0FA655F1A05477DF1B3B614F7D6B124F7DB1DD4FE3C08B03B640F",
      "130.133.110.14", 33445},
@@ -107,19 +136,44 @@ static struct t_twc_bootstrap_node const twc_bootstrap_nodes[] = {
      "46.101.197.175", 443},
 };
 
-static int const twc_bootstrap_count =
-    sizeof(twc_bootstrap_nodes) / sizeof(twc_bootstrap_nodes[0]);
+static int const twc_bootstrap_builtin_count =
+    sizeof(twc_bootstrap_builtin_nodes) /
+    sizeof(twc_bootstrap_builtin_nodes[0]);
+
+/* nodes loaded from the node file, if any */
+static struct t_twc_bootstrap_node *twc_bootstrap_file_nodes = NULL;
+static int twc_bootstrap_file_count = 0;
+
+/* nodes currently used for bootstrapping */
+static struct t_twc_bootstrap_node const *twc_bootstrap_nodes =
+    twc_bootstrap_builtin_nodes;
+static int twc_bootstrap_count =
+    sizeof(twc_bootstrap_builtin_nodes) /
+    sizeof(twc_bootstrap_builtin_nodes[0]);
+
+/**
+ * Check that a string is a hex-encoded Tox public key.
+ */
+bool
+twc_bootstrap_valid_key(const char *key)
+{
+    uint8_t binary_key[TOX_PUBLIC_KEY_SIZE];
+    return strlen(key) == TOX_PUBLIC_KEY_SIZE * 2 &&
+           twc_hex2bin(key, TOX_PUBLIC_KEY_SIZE, binary_key);
+}
 
 /**
  * Bootstrap a Tox object with a DHT bootstrap node. Returns the result of
- * tox_bootstrap_from_address.
+ * tox_bootstrap, or 0 if the public key is invalid.
  */
 int
 twc_bootstrap_tox(Tox *tox, const char *address, uint16_t port,
                   const char *public_key)
 {
-    uint8_t binary_key[TOX_ADDRESS_SIZE];
-    twc_hex2bin(public_key, TOX_ADDRESS_SIZE, binary_key);
+    uint8_t binary_key[TOX_PUBLIC_KEY_SIZE];
+    if (strlen(public_key) != TOX_PUBLIC_KEY_SIZE * 2 ||
+        !twc_hex2bin(public_key, TOX_PUBLIC_KEY_SIZE, binary_key))
+        return 0;
     TOX_ERR_BOOTSTRAP err;
 
     int result = tox_bootstrap(tox, address, port, binary_key, &err);
@@ -128,12 +182,759 @@ twc_bootstrap_tox(Tox *tox, const char *address, uint16_t port,
 }
 
 /**
- * Bootstrap a Tox object with a random DHT bootstrap node.
+ * Free an array of nodes loaded from a node file.
+ */
+void
+twc_bootstrap_free_nodes(struct t_twc_bootstrap_node *nodes, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        free(nodes[i].key);
+        free(nodes[i].address);
+    }
+    free(nodes);
+}
+
+/**
+ * Parse a node object from a node file into node. Returns false if the
+ * object is malformed; a usable node has its key and address set, and the
+ * caller must free them.
+ */
+bool
+twc_bootstrap_parse_node(struct t_twc_json *json,
+                         struct t_twc_bootstrap_node *node)
+{
+    double port = 0;
+    bool status_udp = true, status_tcp = true;
+
+    node->key = NULL;
+    node->address = NULL;
+    node->port = 0;
+
+    if (!twc_json_expect(json, '{'))
+        return false;
+
+    if (!twc_json_accept(json, '}'))
+    {
+        do
+        {
+            char *name = twc_json_string(json);
+            if (!name || !twc_json_expect(json, ':'))
+            {
+                free(name);
+                break;
+            }
+
+            if (strcmp(name, "ipv4") == 0 && !node->address)
+                node->address = twc_json_string(json);
+            else if (strcmp(name, "public_key") == 0 && !node->key)
+                node->key = twc_json_string(json);
+            else if (strcmp(name, "port") == 0)
+                twc_json_number(json, &port);
+            else if (strcmp(name, "status_udp") == 0)
+                twc_json_boolean(json, &status_udp);
+            else if (strcmp(name, "status_tcp") == 0)
+                twc_json_boolean(json, &status_tcp);
+            else
+                twc_json_skip(json);
+
+            free(name);
+        } while (!json->error && twc_json_accept(json, ','));
+
+        if (!twc_json_expect(json, '}'))
+        {
+            free(node->address);
+            free(node->key);
+            return false;
+        }
+    }
+
+    /* skip nodes that are offline, have no IPv4 address ("-" in the
+     * nodes.tox.chat list) or have a bad key or port */
+    if (!(status_udp || status_tcp) || !node->address || !node->key ||
+        !node->address[0] || strcmp(node->address, "-") == 0 ||
+        !twc_bootstrap_valid_key(node->key) || port < 1 || port > UINT16_MAX)
+    {
+        free(node->address);
+        free(node->key);
+        node->address = NULL;
+        node->key = NULL;
+        return true;
+    }
+
+    node->port = port;
+    return true;
+}
+
+/**
+ * Parse a node file in the nodes.tox.chat JSON format, i.e. an object with a
+ * "nodes" array of node objects. Returns the number of usable nodes, stored
+ * in a newly allocated array in nodes, or -1 on error. A missing, null or
+ * empty "nodes" array is not an error.
+ */
+int
+twc_bootstrap_parse_nodes(const char *text,
+                          struct t_twc_bootstrap_node **nodes)
+{
+    struct t_twc_json json;
+    twc_json_init(&json, text);
+
+    int count = 0;
+    int size = 0;
+    *nodes = NULL;
+
+    if (!twc_json_expect(&json, '{'))
+        return -1;
+
+    /* a file without nodes is valid, just not usable */
+    if (twc_json_accept(&json, '}'))
+        return 0;
+
+    do
+    {
+        char *name = twc_json_string(&json);
+        if (!name || !twc_json_expect(&json, ':'))
+        {
+            free(name);
+            break;
+        }
+
+        if (strcmp(name, "nodes") != 0)
+        {
+            free(name);
+            twc_json_skip(&json);
+            continue;
+        }
+        free(name);
+
+        if (twc_json_peek(&json) != '[')
+        {
+            twc_json_skip(&json);
+            continue;
+        }
+        twc_json_expect(&json, '[');
+        if (twc_json_accept(&json, ']'))
+            continue;
+
+        do
+        {
+            struct t_twc_bootstrap_node node;
+            if (!twc_bootstrap_parse_node(&json, &node) || !node.key)
+                continue;
+
+            if (count == size)
+            {
+                size = size ? size * 2 : 32;
+                struct t_twc_bootstrap_node *resized =
+                    realloc(*nodes, size * sizeof(**nodes));
+                if (!resized)
+                {
+                    free(node.key);
+                    free(node.address);
+                    json.error = true;
+                    break;
+                }
+                *nodes = resized;
+            }
+            (*nodes)[count++] = node;
+        } while (!json.error && twc_json_accept(&json, ','));
+
+        twc_json_expect(&json, ']');
+    } while (!json.error && twc_json_accept(&json, ','));
+
+    twc_json_expect(&json, '}');
+
+    if (json.error)
+    {
+        twc_bootstrap_free_nodes(*nodes, count);
+        *nodes = NULL;
+        return -1;
+    }
+
+    return count;
+}
+
+/**
+ * Return the expanded path of the node file, or NULL if none is set. Must be
+ * freed.
+ */
+char *
+twc_bootstrap_file_path()
+{
+    const char *path = weechat_config_string(twc_config_bootstrap_file);
+    if (!path || !path[0])
+        return NULL;
+
+    const char *weechat_dir = weechat_info_get("weechat_dir", NULL);
+    return weechat_string_replace(path, "%h", weechat_dir);
+}
+
+/**
+ * (Re)load the bootstrap node list from the node file set in the
+ * tox.network.bootstrap_file option, falling back to the built-in list if
+ * the file is not set, does not exist or has no usable nodes.
+ *
+ * Returns the number of nodes loaded from the file, 0 if the built-in list
+ * is used, or -1 if the file could not be parsed. On error, the previously
+ * loaded list is kept.
+ */
+int
+twc_bootstrap_reload()
+{
+    char *path = twc_bootstrap_file_path();
+    FILE *file = path ? fopen(path, "r") : NULL;
+    free(path);
+
+    struct t_twc_bootstrap_node *nodes = NULL;
+    int count = 0;
+
+    if (file)
+    {
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        rewind(file);
+
+        char *text = size >= 0 ? malloc(size + 1) : NULL;
+        if (text && fread(text, 1, size, file) == (size_t)size)
+        {
+            text[size] = '\0';
+            count = twc_bootstrap_parse_nodes(text, &nodes);
+        }
+        else
+        {
+            count = -1;
+        }
+
+        free(text);
+        fclose(file);
+    }
+
+    if (count < 0)
+        return -1;
+
+    twc_bootstrap_free_nodes(twc_bootstrap_file_nodes,
+                             twc_bootstrap_file_count);
+    twc_bootstrap_file_nodes = nodes;
+    twc_bootstrap_file_count = count;
+
+    if (count > 0)
+    {
+        twc_bootstrap_nodes = twc_bootstrap_file_nodes;
+        twc_bootstrap_count = twc_bootstrap_file_count;
+    }
+    else
+    {
+        twc_bootstrap_nodes = twc_bootstrap_builtin_nodes;
+        twc_bootstrap_count = twc_bootstrap_builtin_count;
+    }
+
+    return count;
+}
+
+/**
+ * Return the path to a profile's bootstrap node cache. Must be freed.
+ */
+char *
+twc_bootstrap_cache_path(struct t_twc_profile *profile)
+{
+    char *data_path = twc_profile_expanded_data_path(profile);
+    if (!data_path)
+        return NULL;
+
+    size_t length = strlen(data_path) + strlen(".nodes") + 1;
+    char *cache_path = malloc(length);
+    if (cache_path)
+        snprintf(cache_path, length, "%s.nodes", data_path);
+
+    free(data_path);
+    return cache_path;
+}
+
+/**
+ * Free a cached bootstrap node.
+ */
+void
+twc_bootstrap_cache_node_free(struct t_twc_bootstrap_cache_node *node)
+{
+    free(node->address);
+    free(node);
+}
+
+/**
+ * Find a node in a profile's bootstrap node cache by its public key. If it is
+ * not found and create is true, a new node is added to the cache.
+ */
+struct t_twc_bootstrap_cache_node *
+twc_bootstrap_cache_get(struct t_twc_profile *profile, const char *key,
+                        const char *address, uint16_t port, bool create)
+{
+    size_t index;
+    struct t_twc_list_item *item;
+    twc_list_foreach (profile->bootstrap_cache, index, item)
+    {
+        struct t_twc_bootstrap_cache_node *node = item->bootstrap_node;
+        if (weechat_strcasecmp(node->key, key) == 0)
+        {
+            /* node may have moved */
+            if (strcmp(node->address, address) != 0)
+            {
+                free(node->address);
+                node->address = strdup(address);
+            }
+            node->port = port;
+            return node;
+        }
+    }
+
+    if (!create || strlen(key) != TOX_PUBLIC_KEY_SIZE * 2)
+        return NULL;
+
+    struct t_twc_bootstrap_cache_node *node =
+        calloc(1, sizeof(struct t_twc_bootstrap_cache_node));
+    if (!node)
+        return NULL;
+
+    memcpy(node->key, key, sizeof(node->key));
+    node->address = strdup(address);
+    node->port = port;
+    if (!node->address)
+    {
+        free(node);
+        return NULL;
+    }
+
+    twc_list_item_new_data_add(profile->bootstrap_cache, node);
+
+    return node;
+}
+
+/**
+ * Return true if a cached node has failed too often or has not worked for
+ * too long, and should be forgotten.
+ */
+bool
+twc_bootstrap_cache_node_expired(struct t_twc_bootstrap_cache_node *node,
+                                 time_t now)
+{
+    if (node->failures >= node->successes + TWC_BOOTSTRAP_CACHE_MAX_FAILURES)
+        return true;
+
+    return node->successes > 0 &&
+           now - node->last_success > TWC_BOOTSTRAP_CACHE_MAX_AGE;
+}
+
+/**
+ * Remove expired nodes from a profile's bootstrap node cache.
+ */
+void
+twc_bootstrap_cache_prune(struct t_twc_profile *profile)
+{
+    time_t now = time(NULL);
+    struct t_twc_list_item *item = profile->bootstrap_cache->head;
+    while (item)
+    {
+        struct t_twc_list_item *next_item = item->next_item;
+        if (!item->bootstrap_node->pending &&
+            twc_bootstrap_cache_node_expired(item->bootstrap_node, now))
+        {
+            twc_bootstrap_cache_node_free(twc_list_remove(item));
+        }
+        item = next_item;
+    }
+}
+
+/**
+ * qsort comparator ordering cached nodes from best to worst: highest success
+ * ratio first, then lowest latency.
+ */
+int
+twc_bootstrap_cache_compare(const void *a, const void *b)
+{
+    struct t_twc_bootstrap_cache_node const *node_a =
+        *(struct t_twc_bootstrap_cache_node *const *)a;
+    struct t_twc_bootstrap_cache_node const *node_b =
+        *(struct t_twc_bootstrap_cache_node *const *)b;
+
+    double ratio_a = (double)node_a->successes /
+                     (node_a->successes + node_a->failures + 1);
+    double ratio_b = (double)node_b->successes /
+                     (node_b->successes + node_b->failures + 1);
+    if (ratio_a != ratio_b)
+        return ratio_a < ratio_b ? 1 : -1;
+
+    return (node_a->latency > node_b->latency) -
+           (node_a->latency < node_b->latency);
+}
+
+/**
+ * Fill nodes with the cached nodes of a profile that have worked at least
+ * once, sorted from best to worst. nodes must have room for all cached
+ * nodes. Returns the number of nodes.
+ */
+size_t
+twc_bootstrap_cache_sorted(struct t_twc_profile *profile,
+                           struct t_twc_bootstrap_cache_node **nodes)
+{
+    size_t count = 0;
+    size_t index;
+    struct t_twc_list_item *item;
+    twc_list_foreach (profile->bootstrap_cache, index, item)
+    {
+        if (item->bootstrap_node->successes > 0)
+            nodes[count++] = item->bootstrap_node;
+    }
+
+    qsort(nodes, count, sizeof(*nodes), twc_bootstrap_cache_compare);
+
+    return count;
+}
+
+/**
+ * Bootstrap a profile with a single node. If UDP is disabled, the node is
+ * also added as a TCP relay. A node with an invalid key or that toxcore
+ * rejects is counted as failed right away; otherwise it is marked pending
+ * until the outcome of the attempt is known.
+ */
+void
+twc_bootstrap_node(struct t_twc_profile *profile,
+                   struct t_twc_bootstrap_cache_node *node, bool tcp_relay)
+{
+    uint8_t binary_key[TOX_PUBLIC_KEY_SIZE];
+    if (!twc_hex2bin(node->key, TOX_PUBLIC_KEY_SIZE, binary_key))
+    {
+        ++(node->failures);
+        return;
+    }
+
+    TOX_ERR_BOOTSTRAP err = TOX_ERR_BOOTSTRAP_OK;
+    tox_bootstrap(profile->tox, node->address, node->port, binary_key, &err);
+    if (err == TOX_ERR_BOOTSTRAP_OK && tcp_relay)
+        tox_add_tcp_relay(profile->tox, node->address, node->port, binary_key,
+                          &err);
+
+    if (err == TOX_ERR_BOOTSTRAP_OK)
+        node->pending = true;
+    else
+        ++(node->failures);
+}
+
+/**
+ * Start a bootstrap attempt for a profile, using the number of distinct
+ * nodes set in its bootstrap_nodes option. Nodes from the profile's node
+ * cache are preferred, and the rest are picked at random from the built-in
+ * list. The nodes used are scored by twc_bootstrap_check.
+ */
+void
+twc_bootstrap_profile(struct t_twc_profile *profile)
+{
+    TWC_SPAN_BEGIN(start);
+    int count = profile->values.bootstrap_nodes;
+    bool tcp_relay = !profile->values.udp;
+    int used = 0;
+
+    profile->bootstrap_time = twc_stats_time();
+
+    /* prefer nodes that have worked before; both the cache and the node list
+     * come from files, so their size is not bounded */
+    struct t_twc_bootstrap_cache_node **cached =
+        malloc((profile->bootstrap_cache->count + 1) * sizeof(*cached));
+    if (cached)
+    {
+        size_t cached_count = twc_bootstrap_cache_sorted(profile, cached);
+        for (size_t i = 0; i < cached_count && used < count; ++i)
+        {
+            twc_bootstrap_node(profile, cached[i], tcp_relay);
+            ++used;
+        }
+        free(cached);
+    }
+
+    /* fill up with distinct random nodes from the built-in list, using a
+     * partial Fisher-Yates shuffle; always use at least one so a stale cache
+     * can not keep us offline */
+    int random_count = used < count ? count - used : 1;
+    int *indices = malloc(twc_bootstrap_count * sizeof(*indices));
+    if (!indices)
+    {
+        TWC_SPAN_END(start, "profile", "bootstrap", profile);
+        return;
+    }
+    for (int i = 0; i < twc_bootstrap_count; ++i)
+        indices[i] = i;
+
+    for (int i = 0; i < twc_bootstrap_count && random_count > 0; ++i)
+    {
+        int j = i + rand() % (twc_bootstrap_count - i);
+        int tmp = indices[i];
+        indices[i] = indices[j];
+        indices[j] = tmp;
+
+        struct t_twc_bootstrap_node const *const node =
+            &twc_bootstrap_nodes[indices[i]];
+        struct t_twc_bootstrap_cache_node *cache_node = twc_bootstrap_cache_get(
+            profile, node->key, node->address, node->port, true);
+
+        /* skip nodes already used from the cache */
+        if (!cache_node || cache_node->pending)
+            continue;
+
+        twc_bootstrap_node(profile, cache_node, tcp_relay);
+        --random_count;
+    }
+    free(indices);
+
+    TWC_SPAN_END(start, "profile", "bootstrap", profile);
+}
+
+/**
+ * Return the time to wait for a connection before retrying, in
+ * microseconds. Doubles with every failed attempt, up to
+ * TWC_BOOTSTRAP_MAX_TIMEOUT.
+ */
+int64_t
+twc_bootstrap_timeout(struct t_twc_profile *profile)
+{
+    int64_t timeout = TWC_BOOTSTRAP_TIMEOUT;
+    for (int i = 0; i < profile->bootstrap_attempts; ++i)
+    {
+        timeout *= 2;
+        if (timeout >= TWC_BOOTSTRAP_MAX_TIMEOUT)
+            return TWC_BOOTSTRAP_MAX_TIMEOUT;
+    }
+
+    return timeout;
+}
+
+/**
+ * Check the outcome of a profile's bootstrap attempt; called on every Tox
+ * iteration. If the profile has connected, the nodes used are credited with
+ * a success. If it is still offline when the attempt times out, they are
+ * counted as failed and the profile is bootstrapped again, with the timeout
+ * growing exponentially. Toxcore does not report which node answered, so all
+ * nodes in an attempt are scored alike.
+ */
+void
+twc_bootstrap_check(struct t_twc_profile *profile, TOX_CONNECTION connection)
+{
+    bool connected = connection != TOX_CONNECTION_NONE;
+
+    if (!profile->bootstrap_time)
+    {
+        /* lost our connection; give toxcore a chance to recover on its own
+         * before bootstrapping again */
+        if (!connected)
+            profile->bootstrap_time = twc_stats_time();
+        return;
+    }
+
+    int64_t elapsed = twc_stats_time() - profile->bootstrap_time;
+    if (!connected && elapsed < twc_bootstrap_timeout(profile))
+        return;
+
+    time_t now = time(NULL);
+    uint32_t latency = elapsed / 1000;
+
+    size_t index;
+    struct t_twc_list_item *item;
+    twc_list_foreach (profile->bootstrap_cache, index, item)
+    {
+        struct t_twc_bootstrap_cache_node *node = item->bootstrap_node;
+        if (!node->pending)
+            continue;
+
+        node->pending = false;
+        if (connected)
+        {
+            /* moving average, weighing the latest attempt by 1/4 */
+            node->latency = node->successes
+                                ? (node->latency * 3 + latency) / 4
+                                : latency;
+            node->last_success = now;
+            ++(node->successes);
+        }
+        else
+        {
+            ++(node->failures);
+        }
+    }
+
+    twc_bootstrap_cache_prune(profile);
+    twc_bootstrap_cache_save(profile);
+
+    if (connected)
+    {
+        profile->bootstrap_time = 0;
+        profile->bootstrap_attempts = 0;
+    }
+    else
+    {
+        ++(profile->bootstrap_attempts);
+        weechat_printf(profile->buffer,
+                       "%sstill not connected, bootstrapping again "
+                       "(attempt %d)",
+                       weechat_prefix("network"),
+                       profile->bootstrap_attempts + 1);
+        twc_bootstrap_profile(profile);
+    }
+}
+
+/**
+ * Load a profile's bootstrap node cache from disk, replacing any nodes in
+ * memory.
+ */
+void
+twc_bootstrap_cache_load(struct t_twc_profile *profile)
+{
+    struct t_twc_bootstrap_cache_node *node;
+    while ((node = twc_list_pop(profile->bootstrap_cache)))
+        twc_bootstrap_cache_node_free(node);
+    profile->bootstrap_time = 0;
+
+    char *path = twc_bootstrap_cache_path(profile);
+    if (!path)
+        return;
+
+    FILE *file = fopen(path, "r");
+    free(path);
+    if (!file)
+        return;
+
+    /* only nodes that have worked are saved, so anything else or beyond
+     * the cache size comes from a corrupt file */
+    size_t loaded = 0;
+    char line[512];
+    while (loaded < TWC_BOOTSTRAP_CACHE_MAX_SIZE &&
+           fgets(line, sizeof(line), file))
+    {
+        char key[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+        char address[256];
+        unsigned int port, successes, failures, latency;
+        long long last_success;
+
+        if (sscanf(line, "%64s %255s %u %u %u %u %lld", key, address, &port,
+                   &successes, &failures, &latency, &last_success) != 7 ||
+            port > UINT16_MAX || successes == 0 ||
+            !twc_bootstrap_valid_key(key))
+            continue;
+
+        node = twc_bootstrap_cache_get(profile, key, address, port, true);
+        if (node)
+        {
+            node->successes = successes;
+            node->failures = failures;
+            node->latency = latency;
+            node->last_success = last_success;
+            ++loaded;
+        }
+    }
+
+    fclose(file);
+
+    twc_bootstrap_cache_prune(profile);
+}
+
+/**
+ * Save the best nodes in a profile's bootstrap node cache to disk.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+twc_bootstrap_cache_save(struct t_twc_profile *profile)
+{
+    char *path = twc_bootstrap_cache_path(profile);
+    if (!path)
+        return -1;
+
+    /* create containing folder if it doesn't exist */
+    char *rightmost_slash = strrchr(path, '/');
+    if (rightmost_slash)
+    {
+        char *dir_path = weechat_strndup(path, rightmost_slash - path);
+        weechat_mkdir_parents(dir_path, 0755);
+        free(dir_path);
+    }
+
+    /* write to a temporary file and rename it so the cache is never left
+     * half-written */
+    size_t tmp_length = strlen(path) + strlen(".tmp") + 1;
+    char tmp_path[tmp_length];
+    snprintf(tmp_path, tmp_length, "%s.tmp", path);
+
+    struct t_twc_bootstrap_cache_node **nodes =
+        malloc((profile->bootstrap_cache->count + 1) * sizeof(*nodes));
+    FILE *file = nodes ? fopen(tmp_path, "w") : NULL;
+    if (!file)
+    {
+        free(nodes);
+        free(path);
+        return -1;
+    }
+
+    size_t count = twc_bootstrap_cache_sorted(profile, nodes);
+    if (count > TWC_BOOTSTRAP_CACHE_MAX_SIZE)
+        count = TWC_BOOTSTRAP_CACHE_MAX_SIZE;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        fprintf(file, "%s %s %" PRIu16 " %" PRIu32 " %" PRIu32 " %" PRIu32
+                      " %lld\n",
+                nodes[i]->key, nodes[i]->address, nodes[i]->port,
+                nodes[i]->successes, nodes[i]->failures, nodes[i]->latency,
+                (long long)nodes[i]->last_success);
+    }
+    free(nodes);
+
+    int rc = fclose(file) == 0 && rename(tmp_path, path) == 0 ? 0 : -1;
+    if (rc == -1)
+        unlink(tmp_path);
+
+    free(path);
+    return rc;
+}
+
+/**
+ * Delete a profile's bootstrap node cache from disk, along with any temporary
+ * file left behind by an interrupted save.
+ */
+void
+twc_bootstrap_cache_delete(struct t_twc_profile *profile)
+{
+    char *path = twc_bootstrap_cache_path(profile);
+    if (!path)
+        return;
+
+    size_t tmp_length = strlen(path) + strlen(".tmp") + 1;
+    char tmp_path[tmp_length];
+    snprintf(tmp_path, tmp_length, "%s.tmp", path);
+
+    unlink(path);
+    unlink(tmp_path);
+    free(path);
+}
+
+/**
+ * Free a list of cached bootstrap nodes.
+ */
+void
+twc_bootstrap_cache_free_list(struct t_twc_list *list)
+{
+    struct t_twc_bootstrap_cache_node *node;
+    while ((node = twc_list_pop(list)))
+        twc_bootstrap_cache_node_free(node);
+
+    twc_list_free(list);
+}
+
+/**
+ * Free the bootstrap node list loaded from the node file.
  */
 void
-twc_bootstrap_random_node(Tox *tox)
+twc_bootstrap_free()
 {
-    int i = rand() % twc_bootstrap_count;
-    struct t_twc_bootstrap_node const *const node = &twc_bootstrap_nodes[i];
-    twc_bootstrap_tox(tox, node->address, node->port, node->key);
+    twc_bootstrap_free_nodes(twc_bootstrap_file_nodes,
+                             twc_bootstrap_file_count);
+    twc_bootstrap_file_nodes = NULL;
+    twc_bootstrap_file_count = 0;
+    twc_bootstrap_nodes = twc_bootstrap_builtin_nodes;
+    twc_bootstrap_count = twc_bootstrap_builtin_count;
 }
@@ -20,13 +20,63 @@
 #ifndef TOX_WEECHAT_BOOTSTRAP_H
 #define TOX_WEECHAT_BOOTSTRAP_H
 
+#include <stdbool.h>
+#include <time.h>
+
 #include <tox/tox.h>
 
+struct t_twc_profile;
+struct t_twc_list;
+
+/**
+ * A bootstrap node remembered by a profile, with statistics on how well it
+ * has worked.
+ */
+struct t_twc_bootstrap_cache_node
+{
+    char key[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+    char *address;
+    uint16_t port;
+
+    uint32_t successes;
+    uint32_t failures;
+    /* average time from bootstrapping to being connected, in milliseconds */
+    uint32_t latency;
+    time_t last_success;
+
+    /* node was used in the current bootstrap attempt */
+    bool pending;
+};
+
+int
+twc_bootstrap_reload();
+
+bool
+twc_bootstrap_valid_key(const char *key);
+
 int
 twc_bootstrap_tox(Tox *tox, const char *address, uint16_t port,
                   const char *public_key);
 
 void
-twc_bootstrap_random_node(Tox *tox);
+twc_bootstrap_profile(struct t_twc_profile *profile);
+
+void
+twc_bootstrap_check(struct t_twc_profile *profile, TOX_CONNECTION connection);
+
+void
+twc_bootstrap_cache_load(struct t_twc_profile *profile);
+
+int
+twc_bootstrap_cache_save(struct t_twc_profile *profile);
+
+void
+twc_bootstrap_cache_delete(struct t_twc_profile *profile);
+
+void
+twc_bootstrap_cache_free_list(struct t_twc_list *list);
+
+void
+twc_bootstrap_free();
 
 #endif /* TOX_WEECHAT_BOOTSTRAP_H */
@@ -24,9 +24,13 @@
 #include <tox/tox.h>
 #include <weechat/weechat-plugin.h>
 
+#include "twc-friend-cache.h"
+#include "twc-group-peer.h"
 #include "twc-list.h"
+#include "twc-memory.h"
 #include "twc-message-queue.h"
 #include "twc-profile.h"
+#include "twc-stats.h"
 #include "twc-utils.h"
 #include "twc.h"
 
@@ -36,6 +40,10 @@ const char *twc_tag_unsent_message = "tox_unsent";
 const char *twc_tag_sent_message = "tox_sent";
 const char *twc_tag_received_message = "tox_received";
 
+/* chats waiting to be refreshed, and the timer that refreshes them */
+struct t_twc_list *twc_chat_refresh_queue = NULL;
+struct t_hook *twc_chat_refresh_timer = NULL;
+
 int
 twc_chat_buffer_input_callback(const void *pointer, void *data,
                                struct t_gui_buffer *weechat_buffer,
@@ -50,13 +58,22 @@ twc_chat_buffer_close_callback(const void *pointer, void *data,
 struct t_twc_chat *
 twc_chat_new(struct t_twc_profile *profile, const char *name)
 {
-    struct t_twc_chat *chat = malloc(sizeof(struct t_twc_chat));
+    struct t_twc_chat *chat = twc_memory_alloc(
+        profile->memory, TWC_MEMORY_CHATS, sizeof(struct t_twc_chat));
     if (!chat)
         return NULL;
 
     chat->profile = profile;
     chat->friend_number = chat->group_number = -1;
-    chat->nicks = NULL;
+    chat->refresh_item = NULL;
+    chat->peers = NULL;
+    chat->peers_by_number = NULL;
+    chat->peer_count = 0;
+    chat->peer_generation = 0;
+    chat->flood.time = 0;
+    chat->flood.tokens = 0;
+    chat->flood_suppressed = 0;
+    chat->flood_timer = NULL;
 
     size_t full_name_size = strlen(profile->name) + 1 + strlen(name) + 1;
     char *full_name = malloc(full_name_size);
@@ -84,13 +101,12 @@ twc_chat_new(struct t_twc_profile *profile, const char *name)
 
     if (!(chat->buffer))
     {
-        free(chat);
+        twc_memory_free(chat);
         return NULL;
     }
 
     /* set correct logging state for buffer */
-    bool log = TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_LOGGING);
-    twc_set_buffer_logging(chat->buffer, log);
+    twc_set_buffer_logging(chat->buffer, profile->values.logging);
 
     twc_chat_queue_refresh(chat);
     twc_list_item_new_data_add(profile->chats, chat);
@@ -136,7 +152,7 @@ twc_chat_new_group(struct t_twc_profile *profile, int32_t group_number)
 
         chat->nicklist_group =
             weechat_nicklist_add_group(chat->buffer, NULL, NULL, NULL, true);
-        chat->nicks = weechat_list_new();
+        chat->peers = twc_group_peer_table_new();
 
         weechat_buffer_set(chat->buffer, "nicklist", "1");
     }
@@ -157,9 +173,10 @@ twc_chat_refresh(const struct t_twc_chat *chat)
 
     if (chat->friend_number >= 0)
     {
-        name = twc_get_name_nt(chat->profile->tox, chat->friend_number);
-        title =
-            twc_get_status_message_nt(chat->profile->tox, chat->friend_number);
+        name = strdup(
+            twc_friend_cache_name(chat->profile, chat->friend_number));
+        title = strdup(twc_friend_cache_status_message(chat->profile,
+                                                       chat->friend_number));
     }
     else if (chat->group_number >= 0)
     {
@@ -187,24 +204,49 @@ twc_chat_refresh(const struct t_twc_chat *chat)
 }
 
 /**
- * Callback for twc_chat_queue_refresh. Simply calls twc_chat_refresh.
+ * Callback for twc_chat_queue_refresh. Refreshes all queued chats.
  */
 int
 twc_chat_refresh_timer_callback(const void *pointer, void *data, int remaining)
 {
-    twc_chat_refresh(pointer);
+    twc_chat_refresh_timer = NULL;
+
+    struct t_twc_chat *chat;
+    while ((chat = twc_list_pop(twc_chat_refresh_queue)))
+    {
+        chat->refresh_item = NULL;
+        twc_chat_refresh(chat);
+    }
+
+    twc_list_free(twc_chat_refresh_queue);
+    twc_chat_refresh_queue = NULL;
 
     return WEECHAT_RC_OK;
 }
 
 /**
  * Queue a refresh of the buffer in 1ms (i.e. the next event loop tick). Done
- * this way to allow data to update before refreshing interface.
+ * this way to allow data to update before refreshing interface. Refreshes
+ * queued before the next tick are coalesced into one timer, and a chat is
+ * refreshed only once.
  */
 void
 twc_chat_queue_refresh(struct t_twc_chat *chat)
 {
-    weechat_hook_timer(1, 0, 1, twc_chat_refresh_timer_callback, chat, NULL);
+    if (chat->refresh_item)
+        return;
+
+    if (!twc_chat_refresh_queue)
+        twc_chat_refresh_queue = twc_list_new();
+
+    chat->refresh_item =
+        twc_list_item_new_data_add(twc_chat_refresh_queue, chat);
+
+    if (!twc_chat_refresh_timer)
+    {
+        twc_chat_refresh_timer = weechat_hook_timer(
+            1, 0, 1, twc_chat_refresh_timer_callback, NULL, NULL);
+    }
 }
 
 /**
@@ -308,11 +350,10 @@ twc_chat_send_message(struct t_twc_chat *chat, const char *message,
     {
         twc_message_queue_add_friend_message(chat->profile, chat->friend_number,
                                              message, message_type);
-        char *name = twc_get_self_name_nt(chat->profile->tox);
         twc_chat_print_message(chat, "notify_message",
-                               weechat_color("chat_nick_self"), name, message,
-                               message_type);
-        free(name);
+                               weechat_color("chat_nick_self"),
+                               twc_friend_cache_self_name(chat->profile),
+                               message, message_type);
     }
     else if (chat->group_number >= 0)
     {
@@ -325,7 +366,11 @@ twc_chat_send_message(struct t_twc_chat *chat, const char *message,
                                         message_type, (uint8_t *)message,
                                         fit_len, &err);
             if (err != TOX_ERR_CONFERENCE_SEND_MESSAGE_OK)
+            {
+                twc_stats_send_error(chat->profile->stats, true, err);
                 break;
+            }
+            ++chat->profile->stats->counters.messages_out;
             message += fit_len;
             len -= fit_len;
         }
@@ -389,13 +434,25 @@ twc_chat_buffer_close_callback(const void *pointer, void *data,
 void
 twc_chat_free(struct t_twc_chat *chat)
 {
-    weechat_nicklist_remove_all(chat->buffer);
-    if (chat->nicks)
+    twc_flood_cancel(chat);
+
+    /* cancel a pending refresh */
+    if (chat->refresh_item)
     {
-        weechat_list_remove_all(chat->nicks);
-        weechat_list_free(chat->nicks);
+        twc_list_remove(chat->refresh_item);
+        if (!twc_chat_refresh_queue->count)
+        {
+            weechat_unhook(twc_chat_refresh_timer);
+            twc_chat_refresh_timer = NULL;
+            twc_list_free(twc_chat_refresh_queue);
+            twc_chat_refresh_queue = NULL;
+        }
     }
-    free(chat);
+    weechat_nicklist_remove_all(chat->buffer);
+    if (chat->peers)
+        weechat_hashtable_free(chat->peers);
+    twc_memory_free(chat->peers_by_number);
+    twc_memory_free(chat);
 }
 
 /**
@@ -412,5 +469,5 @@ twc_chat_free_list(struct t_twc_list *list)
         twc_chat_free(chat);
     }
 
-    free(list);
+    twc_list_free(list);
 }
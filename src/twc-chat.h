@@ -23,7 +23,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "twc-flood.h"
+
 struct t_twc_list;
+struct t_twc_list_item;
 
 extern const char *twc_tag_unsent_message;
 extern const char *twc_tag_sent_message;
@@ -38,7 +41,18 @@ struct t_twc_chat
     int32_t group_number;
 
     struct t_gui_nick_group *nicklist_group;
-    struct t_weelist *nicks;
+
+    /* item in the refresh queue, if a refresh is pending */
+    struct t_twc_list_item *refresh_item;
+
+    struct t_hashtable *peers;
+    struct t_twc_group_peer **peers_by_number;
+    uint32_t peer_count;
+    unsigned int peer_generation;
+
+    struct t_twc_flood_bucket flood;
+    unsigned int flood_suppressed;
+    struct t_hook *flood_timer;
 };
 
 struct t_twc_chat *
@@ -19,6 +19,7 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -30,11 +31,18 @@
 #include "twc-bootstrap.h"
 #include "twc-chat.h"
 #include "twc-config.h"
+#include "twc-friend-cache.h"
 #include "twc-friend-request.h"
 #include "twc-group-invite.h"
+#include "twc-group-peer.h"
 #include "twc-list.h"
+#include "twc-memory.h"
 #include "twc-profile.h"
+#include "twc-scratch.h"
+#include "twc-span.h"
+#include "twc-stats.h"
 #include "twc-tfer.h"
+#include "twc-trace.h"
 #include "twc-utils.h"
 #include "twc.h"
 
@@ -160,47 +168,22 @@ enum TWC_FRIEND_MATCH
 enum TWC_FRIEND_MATCH
 twc_match_friend(struct t_twc_profile *profile, const char *search_string)
 {
-    uint32_t friend_count = tox_self_get_friend_list_size(profile->tox);
-    uint32_t *friend_numbers = malloc(sizeof(uint32_t) * friend_count);
-    tox_self_get_friend_list(profile->tox, friend_numbers);
-
-    int32_t match = TWC_FRIEND_MATCH_NOMATCH;
-
     char *endptr;
     uint32_t friend_number = (uint32_t)strtoul(search_string, &endptr, 10);
     if (endptr == search_string + strlen(search_string) &&
         tox_friend_exists(profile->tox, friend_number))
         return friend_number;
 
-    size_t search_size = strlen(search_string);
-    for (uint32_t i = 0; i < friend_count; ++i)
-    {
-        if (search_size == TOX_PUBLIC_KEY_SIZE * 2)
-        {
-            uint8_t tox_id[TOX_PUBLIC_KEY_SIZE];
-            char hex_id[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+    int32_t match = twc_friend_cache_search_key(profile, search_string);
+    if (match >= 0)
+        return match;
 
-            if (tox_friend_get_public_key(profile->tox, friend_numbers[i],
-                                          tox_id, NULL))
-            {
-                twc_bin2hex(tox_id, TOX_PUBLIC_KEY_SIZE, hex_id);
+    bool ambiguous;
+    match = twc_friend_cache_search_name(profile, search_string, &ambiguous);
+    if (ambiguous)
+        return TWC_FRIEND_MATCH_AMBIGUOUS;
 
-                if (weechat_strcasecmp(hex_id, search_string) == 0)
-                    return friend_numbers[i];
-            }
-        }
-
-        char *name = twc_get_name_nt(profile->tox, friend_numbers[i]);
-        if (weechat_strcasecmp(name, search_string) == 0)
-        {
-            if (match == TWC_FRIEND_MATCH_NOMATCH)
-                match = friend_numbers[i];
-            else
-                return TWC_FRIEND_MATCH_AMBIGUOUS;
-        }
-    }
-
-    return match;
+    return match >= 0 ? match : TWC_FRIEND_MATCH_NOMATCH;
 }
 
 /**
@@ -210,6 +193,33 @@ int
 twc_cmd_bootstrap(const void *pointer, void *data, struct t_gui_buffer *buffer,
                   int argc, char **argv, char **argv_eol)
 {
+    /* /bootstrap reload */
+    if (argc == 2 && weechat_strcasecmp(argv[1], "reload") == 0)
+    {
+        int count = twc_bootstrap_reload();
+        if (count < 0)
+        {
+            weechat_printf(buffer,
+                           "%scould not parse bootstrap node file, keeping "
+                           "current nodes",
+                           weechat_prefix("error"));
+        }
+        else if (count == 0)
+        {
+            weechat_printf(buffer,
+                           "%sno usable bootstrap node file, using built-in "
+                           "nodes",
+                           weechat_prefix("network"));
+        }
+        else
+        {
+            weechat_printf(buffer, "%sloaded %d bootstrap nodes",
+                           weechat_prefix("network"), count);
+        }
+
+        return WEECHAT_RC_OK;
+    }
+
     struct t_twc_profile *profile = twc_profile_search_buffer(buffer);
     TWC_CHECK_PROFILE(profile);
     TWC_CHECK_PROFILE_LOADED(profile);
@@ -221,6 +231,14 @@ twc_cmd_bootstrap(const void *pointer, void *data, struct t_gui_buffer *buffer,
         uint16_t port = atoi(argv[3]);
         char *public_key = argv[4];
 
+        if (!twc_bootstrap_valid_key(public_key))
+        {
+            weechat_printf(profile->buffer,
+                           "%sBootstrap public key \"%s\" is invalid",
+                           weechat_prefix("error"), public_key);
+            return WEECHAT_RC_OK;
+        }
+
         if (!twc_bootstrap_tox(profile->tox, address, port, public_key))
         {
             weechat_printf(profile->buffer,
@@ -321,7 +339,15 @@ twc_cmd_friend(const void *pointer, void *data, struct t_gui_buffer *buffer,
         }
 
         uint8_t address[TOX_ADDRESS_SIZE];
-        twc_hex2bin(hex_id, TOX_ADDRESS_SIZE, address);
+        if (!twc_hex2bin(hex_id, TOX_ADDRESS_SIZE, address))
+        {
+            weechat_printf(profile->buffer,
+                           "%sTox ID contains invalid characters. Please try "
+                           "again.",
+                           weechat_prefix("error"));
+
+            return WEECHAT_RC_OK;
+        }
 
         if (force)
         {
@@ -335,6 +361,9 @@ twc_cmd_friend(const void *pointer, void *data, struct t_gui_buffer *buffer,
             else if (friend_number != TWC_FRIEND_MATCH_NOMATCH)
                 fail = !tox_friend_delete(profile->tox, friend_number, NULL);
 
+            if (!fail && friend_number != TWC_FRIEND_MATCH_NOMATCH)
+                twc_friend_cache_invalidate(profile, friend_number);
+
             if (fail)
             {
                 weechat_printf(profile->buffer,
@@ -346,12 +375,15 @@ twc_cmd_friend(const void *pointer, void *data, struct t_gui_buffer *buffer,
         }
 
         TOX_ERR_FRIEND_ADD err;
-        (void)tox_friend_add(profile->tox, (uint8_t *)address,
-                             (uint8_t *)message, strlen(message), &err);
+        uint32_t friend_number =
+            tox_friend_add(profile->tox, (uint8_t *)address,
+                           (uint8_t *)message, strlen(message), &err);
 
         switch (err)
         {
             case TOX_ERR_FRIEND_ADD_OK:
+                /* the friend number may belong to a removed friend */
+                twc_friend_cache_invalidate(profile, friend_number);
                 weechat_printf(profile->buffer, "%sFriend request sent!",
                                weechat_prefix("network"));
                 break;
@@ -404,6 +436,7 @@ twc_cmd_friend(const void *pointer, void *data, struct t_gui_buffer *buffer,
         char *name = twc_get_name_nt(profile->tox, friend_number);
         if (tox_friend_delete(profile->tox, friend_number, NULL))
         {
+            twc_friend_cache_invalidate(profile, friend_number);
             weechat_printf(profile->buffer, "%sRemoved %s from friend list.",
                            weechat_prefix("network"), name);
         }
@@ -427,22 +460,22 @@ twc_cmd_friend(const void *pointer, void *data, struct t_gui_buffer *buffer,
         struct t_twc_friend_request *request;
         if (weechat_strcasecmp(argv[2], "all") == 0)
         {
-            size_t index;
             size_t count = 0;
-            struct t_twc_list_item *item;
-            twc_list_foreach (profile->friend_requests, index, item)
+            /* accepting or declining removes the request from the list */
+            while (profile->friend_requests->head)
             {
+                request = profile->friend_requests->head->friend_request;
                 if (accept)
                 {
-                    if (twc_friend_request_accept(item->friend_request))
+                    if (twc_friend_request_accept(request))
                     {
                         ++count;
                     }
                     else
                     {
                         char hex_address[TOX_PUBLIC_KEY_SIZE * 2 + 1];
-                        twc_bin2hex(item->friend_request->tox_id,
-                                    TOX_PUBLIC_KEY_SIZE, hex_address);
+                        twc_bin2hex(request->tox_id, TOX_PUBLIC_KEY_SIZE,
+                                    hex_address);
                         weechat_printf(
                             profile->buffer,
                             "%sCould not accept friend request from %s",
@@ -451,9 +484,10 @@ twc_cmd_friend(const void *pointer, void *data, struct t_gui_buffer *buffer,
                 }
                 else
                 {
-                    twc_friend_request_remove(item->friend_request);
+                    twc_friend_request_remove(request);
                     ++count;
                 }
+                twc_friend_request_free(request);
             }
 
             weechat_printf(profile->buffer, "%s%s %zu friend requests.",
@@ -765,6 +799,7 @@ twc_cmd_name(const void *pointer, void *data, struct t_gui_buffer *buffer,
 
     TOX_ERR_SET_INFO err;
     tox_self_set_name(profile->tox, (uint8_t *)name, strlen(name), &err);
+    twc_friend_cache_invalidate_self(profile);
     if (err != TOX_ERR_SET_INFO_OK)
     {
         char *err_msg;
@@ -821,32 +856,31 @@ twc_cmd_names(const void *pointer, void *data, struct t_gui_buffer *buffer,
         return WEECHAT_RC_OK;
     }
 
-    size_t const num_names = weechat_list_size(chat->nicks);
-
-    if (num_names == 0)
-        return WEECHAT_RC_ERROR;
+    size_t const peer_count = chat->peer_count;
 
-    char const *names[num_names];
-    char const *colors[num_names];
+    char const *names[peer_count ? peer_count : 1];
+    char const *colors[peer_count ? peer_count : 1];
     size_t total_names_length = 0;
+    size_t num_names = 0;
 
-    /* iterate over all names, retrieving length and string representation */
-    struct t_weelist_item *name = weechat_list_get(chat->nicks, 0);
-    size_t index = 0;
-    while (name != NULL)
+    /* iterate over all peers, retrieving length and string representation */
+    for (uint32_t i = 0; i < peer_count; ++i)
     {
-        char const *const name_string = weechat_list_string(name);
-        char const *const color = weechat_info_get("nick_color", name_string);
-
-        names[index] = name_string;
-        colors[index] = color;
+        struct t_twc_group_peer *peer = twc_group_peer_get(chat, i);
+        if (!peer)
+            continue;
 
-        total_names_length += strlen(name_string) + strlen(color);
+        names[num_names] = peer->name;
+        colors[num_names] = twc_group_peer_color(chat, peer);
 
-        ++index;
-        name = weechat_list_next(name);
+        total_names_length +=
+            strlen(names[num_names]) + strlen(colors[num_names]);
+        ++num_names;
     }
 
+    if (num_names == 0)
+        return WEECHAT_RC_ERROR;
+
     /* allocate space for all names, plus spaces and colours, plus \0 */
     char *const names_str = malloc(total_names_length + num_names);
     if (!names_str)
@@ -1200,6 +1234,152 @@ twc_cmd_tox(const void *pointer, void *data, struct t_gui_buffer *buffer,
         return WEECHAT_RC_OK;
     }
 
+    /* /tox stats [<profile>...] */
+    else if (argc >= 2 && weechat_strcasecmp(argv[1], "stats") == 0)
+    {
+        if (argc == 2)
+        {
+            struct t_twc_profile *profile = twc_profile_search_buffer(buffer);
+            if (!profile)
+                return WEECHAT_RC_ERROR;
+
+            twc_stats_print(profile, NULL);
+        }
+        else
+        {
+            for (int i = 2; i < argc; ++i)
+            {
+                char *name = argv[i];
+                struct t_twc_profile *profile = twc_profile_search_name(name);
+                TWC_CHECK_PROFILE_EXISTS(profile);
+
+                twc_stats_print(profile, NULL);
+            }
+        }
+        twc_scratch_print(NULL);
+
+        return WEECHAT_RC_OK;
+    }
+
+    /* /tox memory */
+    else if (argc == 2 && weechat_strcasecmp(argv[1], "memory") == 0)
+    {
+        twc_memory_print(NULL);
+        return WEECHAT_RC_OK;
+    }
+
+    /* /tox trace start <file> | stop | replay <file> [-fast] */
+    else if (argc >= 3 && weechat_strcasecmp(argv[1], "trace") == 0)
+    {
+        struct t_twc_profile *profile = twc_profile_search_buffer(buffer);
+        TWC_CHECK_PROFILE(profile);
+        TWC_CHECK_PROFILE_LOADED(profile);
+
+        if (argc == 4 && weechat_strcasecmp(argv[2], "start") == 0)
+        {
+            if (profile->trace_replay)
+            {
+                weechat_printf(profile->buffer,
+                               "%scannot record a trace while replaying one; "
+                               "use /tox trace stop first",
+                               weechat_prefix("error"));
+                return WEECHAT_RC_OK;
+            }
+
+            if (!twc_trace_start(profile, argv[3]))
+            {
+                weechat_printf(profile->buffer,
+                               "%scould not open trace file \"%s\"",
+                               weechat_prefix("error"), argv[3]);
+                return WEECHAT_RC_OK;
+            }
+
+            weechat_printf(profile->buffer, "%srecording Tox callbacks to %s",
+                           weechat_prefix("network"), argv[3]);
+            return WEECHAT_RC_OK;
+        }
+        else if (argc == 3 && weechat_strcasecmp(argv[2], "stop") == 0)
+        {
+            twc_trace_stop(profile);
+            twc_trace_replay_cancel(profile);
+            return WEECHAT_RC_OK;
+        }
+        else if ((argc == 4 || argc == 5) &&
+                 weechat_strcasecmp(argv[2], "replay") == 0)
+        {
+            bool fast = argc == 5 && strcmp(argv[4], "-fast") == 0;
+            if (argc == 5 && !fast)
+                return WEECHAT_RC_ERROR;
+
+            if (profile->trace_file)
+            {
+                weechat_printf(profile->buffer,
+                               "%scannot replay a trace while recording one; "
+                               "use /tox trace stop first",
+                               weechat_prefix("error"));
+                return WEECHAT_RC_OK;
+            }
+
+            if (!twc_trace_replay(profile, argv[3], fast))
+            {
+                weechat_printf(profile->buffer,
+                               "%scould not read trace file \"%s\"",
+                               weechat_prefix("error"), argv[3]);
+            }
+            return WEECHAT_RC_OK;
+        }
+    }
+
+    /* /tox spans start [<size>] | stop | dump <file> */
+    else if (argc >= 3 && weechat_strcasecmp(argv[1], "spans") == 0)
+    {
+        if ((argc == 3 || argc == 4) &&
+            weechat_strcasecmp(argv[2], "start") == 0)
+        {
+            long capacity = TWC_SPAN_DEFAULT_CAPACITY;
+            if (argc == 4)
+            {
+                char *endptr;
+                capacity = strtol(argv[3], &endptr, 10);
+                if (endptr == argv[3] || *endptr != '\0' || capacity <= 0)
+                    return WEECHAT_RC_ERROR;
+            }
+
+            if (!twc_span_start(capacity))
+            {
+                weechat_printf(NULL,
+                               "%s%s: could not allocate room for %ld spans",
+                               weechat_prefix("error"), weechat_plugin->name,
+                               capacity);
+                return WEECHAT_RC_OK;
+            }
+
+            weechat_printf(NULL, "%s: recording the last %ld spans",
+                           weechat_plugin->name, capacity);
+            return WEECHAT_RC_OK;
+        }
+        else if (argc == 3 && weechat_strcasecmp(argv[2], "stop") == 0)
+        {
+            twc_span_stop();
+            return WEECHAT_RC_OK;
+        }
+        else if (argc == 4 && weechat_strcasecmp(argv[2], "dump") == 0)
+        {
+            size_t count;
+            if (!twc_span_dump(argv[3], &count))
+            {
+                weechat_printf(NULL, "%s%s: could not write span file \"%s\"",
+                               weechat_prefix("error"), weechat_plugin->name,
+                               argv[3]);
+                return WEECHAT_RC_OK;
+            }
+
+            weechat_printf(NULL, "%s: wrote %zu spans to %s",
+                           weechat_plugin->name, count, argv[3]);
+            return WEECHAT_RC_OK;
+        }
+    }
+
     return WEECHAT_RC_ERROR;
 }
 
@@ -1337,11 +1517,14 @@ void
 twc_commands_init()
 {
     weechat_hook_command("bootstrap", "manage bootstrap nodes",
-                         "connect <address> <port> <Tox ID>",
+                         "connect <address> <port> <Tox ID>"
+                         " || reload",
                          "address: internet address of node to bootstrap with\n"
                          "   port: port of the node\n"
-                         " Tox ID: Tox ID of the node",
-                         "connect", twc_cmd_bootstrap, NULL, NULL);
+                         " Tox ID: Tox ID of the node\n"
+                         " reload: reload nodes from the file set in "
+                         "tox.network.bootstrap_file",
+                         "connect || reload", twc_cmd_bootstrap, NULL, NULL);
 
     weechat_hook_command("friend", "manage friends",
                          "list"
@@ -1439,7 +1622,11 @@ twc_commands_init()
         " || delete <name> -yes|-keepdata"
         " || load [<name>...]"
         " || unload [<name>...]"
-        " || reload [<name>...]",
+        " || reload [<name>...]"
+        " || stats [<name>...]"
+        " || memory"
+        " || trace start <file>|stop|replay <file> [-fast]"
+        " || spans start [<size>]|stop|dump <file>",
         "  list: list all Tox profile\n"
         "create: create a new Tox profile\n"
         "delete: delete a Tox profile; requires either -yes "
@@ -1447,13 +1634,39 @@ twc_commands_init()
         "profile but keep the Tox data file\n"
         "  load: load one or more Tox profiles and connect to the network\n"
         "unload: unload one or more Tox profiles\n"
-        "reload: reload one or more Tox profiles\n",
+        "reload: reload one or more Tox profiles\n"
+        " stats: show load timings, message, send error, file transfer and "
+        "callback counters, and tox_iterate and callback durations for one "
+        "or more Tox profiles, followed by scratch buffer statistics\n"
+        "memory: show memory used by lists, message queues, file transfers, "
+        "group invites, friend requests, chats and nicks, for the plugin and "
+        "each profile, with high-water marks\n"
+        " trace: record the Tox callbacks of the current profile to a file, "
+        "stop recording or replaying, or replay a recording into the current "
+        "profile at recorded speed or as fast as possible (-fast) to "
+        "reproduce performance problems offline (\"%h\" will be replaced by "
+        "WeeChat home folder); only friend and group messages for chats "
+        "that are already open are replayed, they are not logged, and their "
+        "statistics are shown when the replay ends instead of being added "
+        "to the profile's; all other events are skipped. WARNING: "
+        "traces store message bodies in plaintext, even if the profile's "
+        "Tox data file is encrypted\n"
+        " spans: record timing spans of plugin activity (Tox iterations, "
+        "callbacks, message queue flushes, file transfer disk I/O, saving, "
+        "loading and bootstrapping) into a ring buffer of the last <size> "
+        "spans (default: 65536), stop recording, or write the recorded spans "
+        "to a Chrome trace event file that can be opened in chrome://tracing "
+        "or Perfetto (\"%h\" will be replaced by WeeChat home folder)\n",
         "list"
         " || create"
         " || delete %(tox_profiles) -yes|-keepdata"
         " || load %(tox_unloaded_profiles)|%*"
         " || unload %(tox_loaded_profiles)|%*"
-        " || reload %(tox_loaded_profiles)|%*",
+        " || reload %(tox_loaded_profiles)|%*"
+        " || stats %(tox_profiles)|%*"
+        " || memory"
+        " || trace start|stop|replay %(filename) -fast"
+        " || spans start|stop|dump %(filename)",
         twc_cmd_tox, NULL, NULL);
     weechat_hook_command(
         "send", "send a file to a friend",
@@ -22,6 +22,7 @@
 
 #include <weechat/weechat-plugin.h>
 
+#include "twc-friend-cache.h"
 #include "twc-list.h"
 #include "twc-profile.h"
 #include "twc-utils.h"
@@ -56,48 +57,29 @@ twc_completion_friend(const void *pointer, void *data,
     if (!profile)
         return WEECHAT_RC_OK;
 
-    uint32_t friend_count = tox_self_get_friend_list_size(profile->tox);
-    uint32_t *friend_numbers = malloc(sizeof(uint32_t) * friend_count);
-    tox_self_get_friend_list(profile->tox, friend_numbers);
-
-    for (uint32_t i = 0; i < friend_count; ++i)
+    const char *prefix =
+        weechat_hook_completion_get_string(completion, "base_word");
+    if (!prefix)
+        prefix = "";
+
+    /* words are kept sorted, so only the matching range is added */
+    const struct t_twc_friend_words *words[2] = {
+        flags & TWC_COMPLETE_FRIEND_ID ? twc_friend_cache_key_words(profile)
+                                       : NULL,
+        flags & TWC_COMPLETE_FRIEND_NAME ? twc_friend_cache_name_words(profile)
+                                         : NULL,
+    };
+    for (size_t i = 0; i < 2; ++i)
     {
-        if (flags & TWC_COMPLETE_FRIEND_ID)
-        {
-            uint8_t tox_id[TOX_PUBLIC_KEY_SIZE];
-            char hex_id[TOX_PUBLIC_KEY_SIZE * 2 + 1];
-
-            TOX_ERR_FRIEND_GET_PUBLIC_KEY err;
-            tox_friend_get_public_key(profile->tox, friend_numbers[i], tox_id,
-                                      &err);
-            if (err == TOX_ERR_FRIEND_GET_PUBLIC_KEY_OK)
-            {
-                twc_bin2hex(tox_id, TOX_PUBLIC_KEY_SIZE, hex_id);
-
-                weechat_hook_completion_list_add(completion, hex_id, 0,
-                                                 WEECHAT_LIST_POS_SORT);
-            }
-        }
+        if (!words[i])
+            continue;
 
-        if (flags & TWC_COMPLETE_FRIEND_NAME)
+        size_t count;
+        size_t start = twc_friend_cache_words_match(words[i], prefix, &count);
+        for (size_t j = start; j < start + count; ++j)
         {
-            char *name = twc_get_name_nt(profile->tox, friend_numbers[i]);
-
-            /* add quotes if needed */
-            if (strchr(name, ' '))
-            {
-                size_t length = strlen(name) + 3;
-                char *quoted_name = malloc(length);
-                snprintf(quoted_name, length, "\"%s\"", name);
-
-                free(name);
-                name = quoted_name;
-            }
-
-            weechat_hook_completion_list_add(completion, name, 0,
-                                             WEECHAT_LIST_POS_SORT);
-
-            free(name);
+            weechat_hook_completion_list_add(completion, words[i]->words[j], 0,
+                                             WEECHAT_LIST_POS_END);
         }
     }
 
@@ -25,6 +25,7 @@
 #include <weechat/weechat-plugin.h>
 
 #include "twc-list.h"
+#include "twc-metrics.h"
 #include "twc-profile.h"
 #include "twc-tfer.h"
 #include "twc.h"
@@ -33,11 +34,17 @@
 
 struct t_config_file *twc_config_file = NULL;
 struct t_config_section *twc_config_section_look = NULL;
+struct t_config_section *twc_config_section_network = NULL;
+struct t_config_section *twc_config_section_metrics = NULL;
 struct t_config_section *twc_config_section_profile = NULL;
 struct t_config_section *twc_config_section_profile_default = NULL;
 
 struct t_config_option *twc_config_friend_request_message;
 struct t_config_option *twc_config_short_id_size;
+struct t_config_option *twc_config_bootstrap_file;
+struct t_config_option *twc_config_metrics_file;
+struct t_config_option *twc_config_metrics_interval;
+struct t_config_option *twc_config_metrics_socket;
 
 char *twc_profile_option_names[TWC_PROFILE_NUM_OPTIONS] = {
     "save_file",
@@ -53,6 +60,11 @@ char *twc_profile_option_names[TWC_PROFILE_NUM_OPTIONS] = {
     "passphrase",
     "logging",
     "downloading_path",
+    "bootstrap_nodes",
+    "highlight_words",
+    "group_message_rate",
+    "group_peer_message_rate",
+    "callback_budget",
 };
 
 /**
@@ -176,6 +188,11 @@ twc_config_profile_change_callback(const void *pointer, void *data,
     struct t_twc_profile *profile = (void *)pointer;
     enum t_twc_profile_option option_index = *(int *)data;
 
+    if (profile)
+        twc_profile_refresh_values(profile);
+    else
+        twc_profile_refresh_values_all();
+
     switch (option_index)
     {
         case TWC_PROFILE_OPTION_LOGGING:
@@ -192,20 +209,43 @@ twc_config_profile_change_callback(const void *pointer, void *data,
                 struct t_twc_list_item *item;
                 twc_list_foreach (twc_profiles, index, item)
                 {
-                    bool logging_enabled = TWC_PROFILE_OPTION_BOOLEAN(
-                        item->profile, TWC_PROFILE_OPTION_LOGGING);
-                    twc_profile_set_logging(item->profile, logging_enabled);
+                    twc_profile_set_logging(item->profile,
+                                            item->profile->values.logging);
                 }
             }
             break;
         case TWC_PROFILE_OPTION_DOWNLOADING_PATH:
             twc_tfer_update_downloading_path(profile);
             break;
+        case TWC_PROFILE_OPTION_HIGHLIGHT_WORDS:
+            if (profile)
+            {
+                twc_profile_highlight_invalidate(profile);
+            }
+            else
+            {
+                /* option changed for default profile, update all profiles */
+                size_t index;
+                struct t_twc_list_item *item;
+                twc_list_foreach (twc_profiles, index, item)
+                    twc_profile_highlight_invalidate(item->profile);
+            }
+            break;
         default:
             break;
     }
 }
 
+/**
+ * Callback for a metrics option being changed.
+ */
+void
+twc_config_metrics_change_callback(const void *pointer, void *data,
+                                   struct t_config_option *option)
+{
+    twc_metrics_reload();
+}
+
 /**
  * Create a new option for a profile. Returns NULL if an error occurs.
  */
@@ -307,6 +347,50 @@ twc_config_init_option(struct t_twc_profile *profile,
                 "WeeChat home folder and \"%p\" by profile name";
             default_value = "%h/tfer/%p/";
             break;
+        case TWC_PROFILE_OPTION_BOOTSTRAP_NODES:
+            type = "integer";
+            description = "number of distinct DHT nodes to bootstrap with "
+                          "(also used as TCP relays if UDP is disabled)";
+            min = 1;
+            max = 100;
+            default_value = "5";
+            break;
+        case TWC_PROFILE_OPTION_HIGHLIGHT_WORDS:
+            type = "string";
+            description = "comma separated list of words to highlight in "
+                          "group chats, in addition to your own name (case "
+                          "insensitive)";
+            default_value = "";
+            break;
+        case TWC_PROFILE_OPTION_GROUP_MESSAGE_RATE:
+            type = "integer";
+            description = "maximum number of messages per second shown in a "
+                          "group chat; excess messages are suppressed and "
+                          "summarized; messages that highlight you are always "
+                          "shown (0 = unlimited)";
+            min = 0;
+            max = INT_MAX;
+            default_value = "0";
+            break;
+        case TWC_PROFILE_OPTION_GROUP_PEER_MESSAGE_RATE:
+            type = "integer";
+            description = "maximum number of messages per second shown from "
+                          "a single group chat peer; excess messages are "
+                          "suppressed and summarized; messages that highlight "
+                          "you are always shown (0 = unlimited)";
+            min = 0;
+            max = INT_MAX;
+            default_value = "0";
+            break;
+        case TWC_PROFILE_OPTION_CALLBACK_BUDGET:
+            type = "integer";
+            description = "log Tox callbacks and iterations that take longer "
+                          "than this many milliseconds to the profile buffer "
+                          "(0 = never)";
+            min = 0;
+            max = 60000;
+            default_value = "50";
+            break;
         default:
             return NULL;
     }
@@ -374,6 +458,44 @@ twc_config_init()
         NULL, 2, TOX_PUBLIC_KEY_SIZE * 2, "8", NULL, 0,
         twc_config_check_value_callback, NULL, NULL, NULL, NULL, NULL, NULL,
         NULL, NULL);
+
+    twc_config_section_network = weechat_config_new_section(
+        twc_config_file, "network", 0, 0, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+
+    twc_config_bootstrap_file = weechat_config_new_option(
+        twc_config_file, twc_config_section_network, "bootstrap_file",
+        "string",
+        "JSON file with DHT bootstrap nodes, in the format of "
+        "https://nodes.tox.chat/json (\"%h\" will be replaced by WeeChat "
+        "home folder); the built-in node list is used if it does not exist; "
+        "run /bootstrap reload after changing it",
+        NULL, 0, 0, "%h/tox/nodes.json", NULL, 0, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL);
+
+    twc_config_section_metrics = weechat_config_new_section(
+        twc_config_file, "metrics", 0, 0, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+
+    twc_config_metrics_file = weechat_config_new_option(
+        twc_config_file, twc_config_section_metrics, "file", "string",
+        "file to periodically write profile metrics to in the OpenMetrics "
+        "text format, replacing it atomically (\"%h\" will be replaced by "
+        "WeeChat home folder); empty to disable",
+        NULL, 0, 0, "", NULL, 0, NULL, NULL, NULL,
+        twc_config_metrics_change_callback, NULL, NULL, NULL, NULL, NULL);
+    twc_config_metrics_interval = weechat_config_new_option(
+        twc_config_file, twc_config_section_metrics, "interval", "integer",
+        "interval between writes of the metrics file, in seconds", NULL, 1,
+        3600, "15", NULL, 0, NULL, NULL, NULL,
+        twc_config_metrics_change_callback, NULL, NULL, NULL, NULL, NULL);
+    twc_config_metrics_socket = weechat_config_new_option(
+        twc_config_file, twc_config_section_metrics, "socket", "string",
+        "unix domain socket serving profile metrics in the OpenMetrics text "
+        "format to every client that connects (\"%h\" will be replaced by "
+        "WeeChat home folder); empty to disable",
+        NULL, 0, 0, "", NULL, 0, NULL, NULL, NULL,
+        twc_config_metrics_change_callback, NULL, NULL, NULL, NULL, NULL);
 }
 
 /**
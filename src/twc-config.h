@@ -24,6 +24,10 @@ struct t_twc_profile;
 
 extern struct t_config_option *twc_config_friend_request_message;
 extern struct t_config_option *twc_config_short_id_size;
+extern struct t_config_option *twc_config_bootstrap_file;
+extern struct t_config_option *twc_config_metrics_file;
+extern struct t_config_option *twc_config_metrics_interval;
+extern struct t_config_option *twc_config_metrics_socket;
 
 enum t_twc_proxy
 {
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <tox/tox.h>
+#include <weechat/weechat-plugin.h>
+
+#include "twc-chat.h"
+#include "twc-group-peer.h"
+#include "twc-profile.h"
+#include "twc-stats.h"
+#include "twc.h"
+
+#include "twc-flood.h"
+
+/* delay before summarizing suppressed messages, in milliseconds */
+#define TWC_FLOOD_SUMMARY_DELAY (1000)
+
+/* number of seconds worth of messages a bucket can hold, i.e. how long a
+ * burst at the full rate is tolerated before messages are suppressed */
+#define TWC_FLOOD_BURST (5)
+
+/* maximum number of peers named in a summary */
+#define TWC_FLOOD_SUMMARY_MAX_PEERS (3)
+
+/**
+ * Refill a bucket at rate tokens per second and check if it has a token to
+ * take. A rate of 0 means no limit.
+ */
+bool
+twc_flood_bucket_ready(struct t_twc_flood_bucket *bucket, int rate,
+                       int64_t now)
+{
+    if (rate <= 0)
+        return true;
+
+    double capacity = (double)rate * TWC_FLOOD_BURST;
+    if (bucket->time)
+    {
+        bucket->tokens += (now - bucket->time) * rate / 1000000.0;
+        if (bucket->tokens > capacity)
+            bucket->tokens = capacity;
+    }
+    else
+    {
+        bucket->tokens = capacity;
+    }
+    bucket->time = now;
+
+    return bucket->tokens >= 1;
+}
+
+/**
+ * Take a token from a bucket that twc_flood_bucket_ready found ready.
+ */
+void
+twc_flood_bucket_take(struct t_twc_flood_bucket *bucket, int rate)
+{
+    if (rate > 0)
+        bucket->tokens -= 1;
+}
+
+/**
+ * Print a summary of messages suppressed in a chat, naming the peers that
+ * flooded the most.
+ */
+int
+twc_flood_summary_timer_callback(const void *pointer, void *data,
+                                 int remaining_calls)
+{
+    struct t_twc_chat *chat = (void *)pointer;
+    chat->flood_timer = NULL;
+
+    /* keep the peers with the most suppressed messages, most first */
+    struct t_twc_group_peer *top[TWC_FLOOD_SUMMARY_MAX_PEERS];
+    int named = 0, unnamed = 0;
+    for (uint32_t i = 0; i < chat->peer_count; ++i)
+    {
+        struct t_twc_group_peer *peer = chat->peers_by_number[i];
+        if (!peer || !peer->flood_suppressed)
+            continue;
+
+        int position = named;
+        while (position > 0 &&
+               top[position - 1]->flood_suppressed < peer->flood_suppressed)
+            --position;
+
+        if (position == TWC_FLOOD_SUMMARY_MAX_PEERS)
+        {
+            ++unnamed;
+            continue;
+        }
+
+        if (named == TWC_FLOOD_SUMMARY_MAX_PEERS)
+            ++unnamed;
+        else
+            ++named;
+        for (int j = named - 1; j > position; --j)
+            top[j] = top[j - 1];
+        top[position] = peer;
+    }
+
+    char peers[512] = "";
+    size_t length = 0;
+    for (int i = 0; i < named && length < sizeof(peers); ++i)
+    {
+        length += snprintf(peers + length, sizeof(peers) - length,
+                           "%s%s: %u", i ? ", " : "", top[i]->name,
+                           top[i]->flood_suppressed);
+    }
+
+    if (unnamed && length < sizeof(peers))
+    {
+        snprintf(peers + length, sizeof(peers) - length,
+                 ", and %d more peer%s", unnamed, unnamed == 1 ? "" : "s");
+    }
+
+    for (uint32_t i = 0; i < chat->peer_count; ++i)
+    {
+        if (chat->peers_by_number[i])
+            chat->peers_by_number[i]->flood_suppressed = 0;
+    }
+
+    weechat_printf_date_tags(chat->buffer, 0, "no_log",
+                             "%sflood: suppressed %u message%s%s%s%s",
+                             weechat_prefix("network"), chat->flood_suppressed,
+                             chat->flood_suppressed == 1 ? "" : "s",
+                             named ? " (" : "", peers, named ? ")" : "");
+    chat->flood_suppressed = 0;
+
+    return WEECHAT_RC_OK;
+}
+
+/**
+ * Check an incoming group message against the chat's and the sending peer's
+ * rate limits. Returns true if the message should be shown; otherwise it is
+ * counted and summarized later. Our own messages are never limited.
+ */
+bool
+twc_flood_check_group_message(struct t_twc_chat *chat,
+                              struct t_twc_group_peer *peer)
+{
+    if (peer && peer->ours)
+        return true;
+
+    int chat_rate = chat->profile->values.group_message_rate;
+    int peer_rate = chat->profile->values.group_peer_message_rate;
+    if (chat_rate <= 0 && peer_rate <= 0)
+        return true;
+
+    /* check both buckets before taking from either, so that a message
+     * suppressed by one limit does not use up the other */
+    int64_t now = twc_stats_time();
+    bool peer_ready =
+        !peer || twc_flood_bucket_ready(&peer->flood, peer_rate, now);
+    bool chat_ready = twc_flood_bucket_ready(&chat->flood, chat_rate, now);
+    if (peer_ready && chat_ready)
+    {
+        if (peer)
+            twc_flood_bucket_take(&peer->flood, peer_rate);
+        twc_flood_bucket_take(&chat->flood, chat_rate);
+        return true;
+    }
+
+    ++(chat->flood_suppressed);
+    if (peer)
+        ++(peer->flood_suppressed);
+
+    if (!chat->flood_timer)
+    {
+        chat->flood_timer =
+            weechat_hook_timer(TWC_FLOOD_SUMMARY_DELAY, 0, 1,
+                               twc_flood_summary_timer_callback, chat, NULL);
+    }
+
+    return false;
+}
+
+/**
+ * Cancel a pending flood summary, e.g. when a chat is freed.
+ */
+void
+twc_flood_cancel(struct t_twc_chat *chat)
+{
+    if (chat->flood_timer)
+    {
+        weechat_unhook(chat->flood_timer);
+        chat->flood_timer = NULL;
+    }
+}
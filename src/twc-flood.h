@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_FLOOD_H
+#define TOX_WEECHAT_FLOOD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct t_twc_chat;
+struct t_twc_group_peer;
+
+/**
+ * A token bucket limiting the rate of incoming messages. It holds at most
+ * TWC_FLOOD_BURST seconds worth of messages.
+ */
+struct t_twc_flood_bucket
+{
+    int64_t time;
+    double tokens;
+};
+
+bool
+twc_flood_check_group_message(struct t_twc_chat *chat,
+                              struct t_twc_group_peer *peer);
+
+void
+twc_flood_cancel(struct t_twc_chat *chat);
+
+#endif /* TOX_WEECHAT_FLOOD_H */
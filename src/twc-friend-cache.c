@@ -0,0 +1,705 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tox/tox.h>
+#include <weechat/weechat-plugin.h>
+
+#include "twc-config.h"
+#include "twc-profile.h"
+#include "twc-utils.h"
+#include "twc.h"
+
+#include "twc-friend-cache.h"
+
+/**
+ * Free a cache entry; called by WeeChat when an entry is removed from the
+ * cache.
+ */
+void
+twc_friend_cache_free_entry_callback(struct t_hashtable *hashtable,
+                                     const void *key, void *value)
+{
+    struct t_twc_friend_cache_entry *entry = value;
+
+    free(entry->name);
+    free(entry->status_message);
+    free(entry->short_id);
+    free(entry);
+}
+
+/**
+ * Free a friend index entry; called by WeeChat when it is removed from the
+ * index.
+ */
+void
+twc_friend_cache_free_index_name_callback(struct t_hashtable *hashtable,
+                                          const void *key, void *value)
+{
+    free(value);
+}
+
+/**
+ * Set up the friend metadata cache of a profile.
+ */
+void
+twc_friend_cache_init(struct t_twc_profile *profile)
+{
+    profile->friend_cache = weechat_hashtable_new(
+        32, WEECHAT_HASHTABLE_INTEGER, WEECHAT_HASHTABLE_POINTER, NULL, NULL);
+    if (profile->friend_cache)
+    {
+        weechat_hashtable_set_pointer(profile->friend_cache,
+                                      "callback_free_value",
+                                      twc_friend_cache_free_entry_callback);
+    }
+    profile->self_name = NULL;
+
+    profile->friend_index_keys = weechat_hashtable_new(
+        32, WEECHAT_HASHTABLE_STRING, WEECHAT_HASHTABLE_INTEGER, NULL, NULL);
+    profile->friend_index_names = weechat_hashtable_new(
+        32, WEECHAT_HASHTABLE_STRING, WEECHAT_HASHTABLE_POINTER, NULL, NULL);
+    if (profile->friend_index_names)
+    {
+        weechat_hashtable_set_pointer(
+            profile->friend_index_names, "callback_free_value",
+            twc_friend_cache_free_index_name_callback);
+    }
+    profile->friend_index_valid = false;
+
+    profile->friend_name_words = (struct t_twc_friend_words){NULL, 0, 0};
+    profile->friend_key_words = (struct t_twc_friend_words){NULL, 0, 0};
+    profile->friend_words_valid = false;
+}
+
+/**
+ * Get the cache entry for a friend, creating an empty one if needed.
+ */
+struct t_twc_friend_cache_entry *
+twc_friend_cache_entry(struct t_twc_profile *profile, int32_t friend_number)
+{
+    struct t_twc_friend_cache_entry *entry =
+        weechat_hashtable_get(profile->friend_cache, &friend_number);
+    if (entry)
+        return entry;
+
+    entry = calloc(1, sizeof(struct t_twc_friend_cache_entry));
+    if (entry)
+        weechat_hashtable_set(profile->friend_cache, &friend_number, entry);
+
+    return entry;
+}
+
+/**
+ * Return a friend's Tox ID in short form. The string belongs to the cache
+ * and is valid until the friend's cache entry is invalidated.
+ */
+const char *
+twc_friend_cache_short_id(struct t_twc_profile *profile, int32_t friend_number)
+{
+    struct t_twc_friend_cache_entry *entry =
+        twc_friend_cache_entry(profile, friend_number);
+    if (!entry)
+        return "";
+
+    /* the short ID length is configurable */
+    int short_id_size = weechat_config_integer(twc_config_short_id_size);
+    if (!entry->short_id || entry->short_id_size != short_id_size)
+    {
+        free(entry->short_id);
+        entry->short_id = twc_get_friend_id_short(profile->tox, friend_number);
+        entry->short_id_size = short_id_size;
+    }
+
+    return entry->short_id ? entry->short_id : "";
+}
+
+/**
+ * Return a friend's name, or their short Tox ID if the name is empty. The
+ * string belongs to the cache and is valid until the friend's cache entry is
+ * invalidated.
+ */
+const char *
+twc_friend_cache_name(struct t_twc_profile *profile, int32_t friend_number)
+{
+    struct t_twc_friend_cache_entry *entry =
+        twc_friend_cache_entry(profile, friend_number);
+    if (!entry)
+        return "";
+
+    if (!entry->name)
+    {
+        TOX_ERR_FRIEND_QUERY err;
+        size_t length =
+            tox_friend_get_name_size(profile->tox, friend_number, &err);
+        if (err != TOX_ERR_FRIEND_QUERY_OK)
+            return twc_friend_cache_short_id(profile, friend_number);
+
+        uint8_t name[length];
+        tox_friend_get_name(profile->tox, friend_number, name, &err);
+        entry->name = twc_null_terminate(name, length);
+    }
+
+    if (!entry->name || !entry->name[0])
+        return twc_friend_cache_short_id(profile, friend_number);
+
+    return entry->name;
+}
+
+/**
+ * Return a friend's status message. The string belongs to the cache and is
+ * valid until the friend's cache entry is invalidated.
+ */
+const char *
+twc_friend_cache_status_message(struct t_twc_profile *profile,
+                                int32_t friend_number)
+{
+    struct t_twc_friend_cache_entry *entry =
+        twc_friend_cache_entry(profile, friend_number);
+    if (!entry)
+        return "";
+
+    if (!entry->status_message)
+    {
+        entry->status_message =
+            twc_get_status_message_nt(profile->tox, friend_number);
+    }
+
+    return entry->status_message ? entry->status_message : "";
+}
+
+/**
+ * Return our own name. The string belongs to the cache and is valid until
+ * twc_friend_cache_invalidate_self is called.
+ */
+const char *
+twc_friend_cache_self_name(struct t_twc_profile *profile)
+{
+    if (!profile->self_name)
+        profile->self_name = twc_get_self_name_nt(profile->tox);
+
+    return profile->self_name ? profile->self_name : "";
+}
+
+/**
+ * Add a friend's name to the friend index by name.
+ */
+void
+twc_friend_cache_index_name_add(struct t_twc_profile *profile,
+                                int32_t friend_number)
+{
+    char *name = twc_fold_case(twc_friend_cache_name(profile, friend_number));
+    if (!name)
+        return;
+
+    struct t_twc_friend_index_name *index_name =
+        weechat_hashtable_get(profile->friend_index_names, name);
+    if (!index_name)
+    {
+        index_name = calloc(1, sizeof(struct t_twc_friend_index_name));
+        if (!index_name)
+        {
+            /* rebuild rather than serve a stale index */
+            profile->friend_index_valid = false;
+            free(name);
+            return;
+        }
+        weechat_hashtable_set(profile->friend_index_names, name, index_name);
+    }
+
+    ++(index_name->count);
+    index_name->friend_numbers += friend_number;
+    free(name);
+}
+
+/**
+ * Remove a friend's name from the friend index by name.
+ */
+void
+twc_friend_cache_index_name_remove(struct t_twc_profile *profile,
+                                   int32_t friend_number)
+{
+    char *name = twc_fold_case(twc_friend_cache_name(profile, friend_number));
+    if (!name)
+        return;
+
+    struct t_twc_friend_index_name *index_name =
+        weechat_hashtable_get(profile->friend_index_names, name);
+    if (index_name)
+    {
+        index_name->friend_numbers -= friend_number;
+        if (--(index_name->count) <= 0)
+            weechat_hashtable_remove(profile->friend_index_names, name);
+    }
+    free(name);
+}
+
+/**
+ * Rebuild the friend index of a profile, mapping hex public keys and folded
+ * names to friend numbers.
+ */
+void
+twc_friend_cache_build_index(struct t_twc_profile *profile)
+{
+    weechat_hashtable_remove_all(profile->friend_index_keys);
+    weechat_hashtable_remove_all(profile->friend_index_names);
+    profile->friend_index_valid = true;
+    profile->friend_index_short_id_size =
+        weechat_config_integer(twc_config_short_id_size);
+
+    size_t friend_count = tox_self_get_friend_list_size(profile->tox);
+    uint32_t *friend_numbers = malloc(sizeof(uint32_t) * (friend_count + 1));
+    if (!friend_numbers)
+    {
+        profile->friend_index_valid = false;
+        return;
+    }
+    tox_self_get_friend_list(profile->tox, friend_numbers);
+
+    for (size_t i = 0; i < friend_count; ++i)
+    {
+        int friend_number = friend_numbers[i];
+
+        uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+        char hex_key[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+        if (tox_friend_get_public_key(profile->tox, friend_number, public_key,
+                                      NULL))
+        {
+            twc_bin2hex(public_key, TOX_PUBLIC_KEY_SIZE, hex_key);
+            weechat_hashtable_set(profile->friend_index_keys, hex_key,
+                                  &friend_number);
+        }
+
+        twc_friend_cache_index_name_add(profile, friend_number);
+    }
+
+    free(friend_numbers);
+}
+
+/**
+ * Make sure a profile's friend index is up to date.
+ */
+void
+twc_friend_cache_check_index(struct t_twc_profile *profile)
+{
+    /* names fall back to short IDs, whose length is configurable */
+    if (!profile->friend_index_valid ||
+        profile->friend_index_short_id_size !=
+            weechat_config_integer(twc_config_short_id_size))
+        twc_friend_cache_build_index(profile);
+}
+
+/**
+ * Find a friend by hex-encoded public key, case insensitive. Returns the
+ * friend number, or -1 if not found.
+ */
+int32_t
+twc_friend_cache_search_key(struct t_twc_profile *profile, const char *hex_key)
+{
+    if (strlen(hex_key) != TOX_PUBLIC_KEY_SIZE * 2)
+        return -1;
+
+    twc_friend_cache_check_index(profile);
+
+    char upper_key[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+    for (size_t i = 0; i <= TOX_PUBLIC_KEY_SIZE * 2; ++i)
+    {
+        char c = hex_key[i];
+        upper_key[i] = (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+    }
+
+    int *friend_number =
+        weechat_hashtable_get(profile->friend_index_keys, upper_key);
+    return friend_number ? *friend_number : -1;
+}
+
+/**
+ * Find a friend by name, ignoring ASCII case. Returns the friend number, or
+ * -1 if not found; ambiguous is set if several friends have the name.
+ */
+int32_t
+twc_friend_cache_search_name(struct t_twc_profile *profile, const char *name,
+                             bool *ambiguous)
+{
+    twc_friend_cache_check_index(profile);
+    *ambiguous = false;
+
+    char *folded = twc_fold_case(name);
+    if (!folded)
+        return -1;
+
+    struct t_twc_friend_index_name *index_name =
+        weechat_hashtable_get(profile->friend_index_names, folded);
+    free(folded);
+
+    if (!index_name)
+        return -1;
+
+    *ambiguous = index_name->count > 1;
+    return *ambiguous ? -1 : index_name->friend_numbers;
+}
+
+/**
+ * Compare at most n characters of two strings, ignoring ASCII case.
+ */
+int
+twc_friend_cache_word_cmp(const char *a, const char *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        int ca = (unsigned char)a[i];
+        int cb = (unsigned char)b[i];
+        if (ca >= 'A' && ca <= 'Z')
+            ca += 'a' - 'A';
+        if (cb >= 'A' && cb <= 'Z')
+            cb += 'a' - 'A';
+
+        if (ca != cb || !ca)
+            return ca - cb;
+    }
+
+    return 0;
+}
+
+/**
+ * Return the index of the first word not sorting before the first length
+ * characters of prefix.
+ */
+size_t
+twc_friend_cache_words_lower_bound(const struct t_twc_friend_words *words,
+                                   const char *prefix, size_t length)
+{
+    size_t low = 0;
+    size_t high = words->count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (twc_friend_cache_word_cmp(words->words[middle], prefix, length) <
+            0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/**
+ * Insert a copy of a word, keeping the words sorted.
+ */
+void
+twc_friend_cache_words_insert(struct t_twc_friend_words *words,
+                              const char *word)
+{
+    if (words->count == words->size)
+    {
+        size_t size = words->size ? words->size * 2 : 32;
+        char **new_words = realloc(words->words, sizeof(char *) * size);
+        if (!new_words)
+            return;
+
+        words->words = new_words;
+        words->size = size;
+    }
+
+    char *copy = strdup(word);
+    if (!copy)
+        return;
+
+    size_t index =
+        twc_friend_cache_words_lower_bound(words, word, strlen(word) + 1);
+    memmove(words->words + index + 1, words->words + index,
+            sizeof(char *) * (words->count - index));
+    words->words[index] = copy;
+    ++words->count;
+}
+
+/**
+ * Remove one occurrence of a word, if present.
+ */
+void
+twc_friend_cache_words_remove(struct t_twc_friend_words *words,
+                              const char *word)
+{
+    size_t length = strlen(word) + 1;
+    for (size_t index =
+             twc_friend_cache_words_lower_bound(words, word, length);
+         index < words->count &&
+         twc_friend_cache_word_cmp(words->words[index], word, length) == 0;
+         ++index)
+    {
+        if (strcmp(words->words[index], word) == 0)
+        {
+            free(words->words[index]);
+            --words->count;
+            memmove(words->words + index, words->words + index + 1,
+                    sizeof(char *) * (words->count - index));
+            return;
+        }
+    }
+}
+
+/**
+ * Free all words.
+ */
+void
+twc_friend_cache_words_clear(struct t_twc_friend_words *words)
+{
+    for (size_t i = 0; i < words->count; ++i)
+        free(words->words[i]);
+    free(words->words);
+    *words = (struct t_twc_friend_words){NULL, 0, 0};
+}
+
+/**
+ * Return the completion word for a friend name, quoted if it contains
+ * spaces. Must be freed.
+ */
+char *
+twc_friend_cache_name_word(const char *name)
+{
+    if (!strchr(name, ' '))
+        return strdup(name);
+
+    size_t length = strlen(name) + 3;
+    char *quoted_name = malloc(length);
+    if (quoted_name)
+        snprintf(quoted_name, length, "\"%s\"", name);
+
+    return quoted_name;
+}
+
+/**
+ * Rebuild the completion words of a profile's friends.
+ */
+void
+twc_friend_cache_build_words(struct t_twc_profile *profile)
+{
+    twc_friend_cache_words_clear(&profile->friend_name_words);
+    twc_friend_cache_words_clear(&profile->friend_key_words);
+    profile->friend_words_valid = true;
+    profile->friend_words_short_id_size =
+        weechat_config_integer(twc_config_short_id_size);
+
+    size_t friend_count = tox_self_get_friend_list_size(profile->tox);
+    uint32_t *friend_numbers = malloc(sizeof(uint32_t) * (friend_count + 1));
+    if (!friend_numbers)
+    {
+        profile->friend_words_valid = false;
+        return;
+    }
+    tox_self_get_friend_list(profile->tox, friend_numbers);
+
+    for (size_t i = 0; i < friend_count; ++i)
+    {
+        uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+        char hex_key[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+        if (tox_friend_get_public_key(profile->tox, friend_numbers[i],
+                                      public_key, NULL))
+        {
+            twc_bin2hex(public_key, TOX_PUBLIC_KEY_SIZE, hex_key);
+            twc_friend_cache_words_insert(&profile->friend_key_words, hex_key);
+        }
+
+        char *word = twc_friend_cache_name_word(
+            twc_friend_cache_name(profile, friend_numbers[i]));
+        if (word)
+        {
+            twc_friend_cache_words_insert(&profile->friend_name_words, word);
+            free(word);
+        }
+    }
+
+    free(friend_numbers);
+}
+
+/**
+ * Make sure a profile's completion words are up to date.
+ */
+void
+twc_friend_cache_check_words(struct t_twc_profile *profile)
+{
+    if (!profile->friend_words_valid ||
+        profile->friend_words_short_id_size !=
+            weechat_config_integer(twc_config_short_id_size))
+        twc_friend_cache_build_words(profile);
+}
+
+/**
+ * Return the sorted name completion words of a profile's friends.
+ */
+const struct t_twc_friend_words *
+twc_friend_cache_name_words(struct t_twc_profile *profile)
+{
+    twc_friend_cache_check_words(profile);
+    return &profile->friend_name_words;
+}
+
+/**
+ * Return the sorted hex public key completion words of a profile's friends.
+ */
+const struct t_twc_friend_words *
+twc_friend_cache_key_words(struct t_twc_profile *profile)
+{
+    twc_friend_cache_check_words(profile);
+    return &profile->friend_key_words;
+}
+
+/**
+ * Find the words starting with a prefix, ignoring ASCII case. Returns the
+ * index of the first match and sets count to the number of matches.
+ */
+size_t
+twc_friend_cache_words_match(const struct t_twc_friend_words *words,
+                             const char *prefix, size_t *count)
+{
+    size_t length = strlen(prefix);
+    size_t start = twc_friend_cache_words_lower_bound(words, prefix, length);
+
+    size_t end = start;
+    while (end < words->count &&
+           twc_friend_cache_word_cmp(words->words[end], prefix, length) == 0)
+        ++end;
+
+    *count = end - start;
+    return start;
+}
+
+/**
+ * Update a friend's cached name. Used from the name change callback, which
+ * toxcore calls before the name is changed.
+ */
+void
+twc_friend_cache_set_name(struct t_twc_profile *profile, int32_t friend_number,
+                          const char *name)
+{
+    struct t_twc_friend_cache_entry *entry =
+        twc_friend_cache_entry(profile, friend_number);
+    if (!entry)
+        return;
+
+    /* toxcore repeats the name whenever a friend reconnects */
+    if (entry->name && strcmp(entry->name, name) == 0)
+        return;
+
+    /* the callback is called before the name changes, so the old word and
+     * index entry can still be found */
+    char *old_word = NULL;
+    if (profile->friend_words_valid)
+    {
+        old_word = twc_friend_cache_name_word(
+            twc_friend_cache_name(profile, friend_number));
+    }
+    if (profile->friend_index_valid)
+        twc_friend_cache_index_name_remove(profile, friend_number);
+
+    free(entry->name);
+    entry->name = strdup(name);
+
+    if (profile->friend_index_valid)
+        twc_friend_cache_index_name_add(profile, friend_number);
+
+    if (old_word)
+    {
+        twc_friend_cache_words_remove(&profile->friend_name_words, old_word);
+        free(old_word);
+
+        char *new_word = twc_friend_cache_name_word(
+            twc_friend_cache_name(profile, friend_number));
+        if (new_word)
+        {
+            twc_friend_cache_words_insert(&profile->friend_name_words,
+                                          new_word);
+            free(new_word);
+        }
+    }
+}
+
+/**
+ * Update a friend's cached status message. Used from the status message
+ * callback, which toxcore calls before the message is changed.
+ */
+void
+twc_friend_cache_set_status_message(struct t_twc_profile *profile,
+                                    int32_t friend_number,
+                                    const char *status_message)
+{
+    struct t_twc_friend_cache_entry *entry =
+        twc_friend_cache_entry(profile, friend_number);
+    if (!entry)
+        return;
+
+    free(entry->status_message);
+    entry->status_message = strdup(status_message);
+}
+
+/**
+ * Drop a friend's cached metadata, e.g. when the friend number is added or
+ * removed. Invalidates strings returned for the friend.
+ */
+void
+twc_friend_cache_invalidate(struct t_twc_profile *profile,
+                            int32_t friend_number)
+{
+    weechat_hashtable_remove(profile->friend_cache, &friend_number);
+    profile->friend_index_valid = false;
+    profile->friend_words_valid = false;
+}
+
+/**
+ * Drop our own cached name, after it is changed.
+ */
+void
+twc_friend_cache_invalidate_self(struct t_twc_profile *profile)
+{
+    free(profile->self_name);
+    profile->self_name = NULL;
+    twc_profile_highlight_invalidate(profile);
+}
+
+/**
+ * Drop all cached metadata of a profile, e.g. when it is unloaded.
+ */
+void
+twc_friend_cache_clear(struct t_twc_profile *profile)
+{
+    weechat_hashtable_remove_all(profile->friend_cache);
+    twc_friend_cache_invalidate_self(profile);
+    profile->friend_index_valid = false;
+    twc_friend_cache_words_clear(&profile->friend_name_words);
+    twc_friend_cache_words_clear(&profile->friend_key_words);
+    profile->friend_words_valid = false;
+}
+
+/**
+ * Free the friend metadata cache of a profile.
+ */
+void
+twc_friend_cache_free_profile(struct t_twc_profile *profile)
+{
+    twc_friend_cache_invalidate_self(profile);
+    weechat_hashtable_free(profile->friend_cache);
+    weechat_hashtable_free(profile->friend_index_keys);
+    weechat_hashtable_free(profile->friend_index_names);
+    twc_friend_cache_words_clear(&profile->friend_name_words);
+    twc_friend_cache_words_clear(&profile->friend_key_words);
+}
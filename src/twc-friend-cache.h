@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_FRIEND_CACHE_H
+#define TOX_WEECHAT_FRIEND_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct t_twc_profile;
+
+/**
+ * Cached metadata of a friend, so message callbacks need not query toxcore
+ * and allocate for every message.
+ */
+struct t_twc_friend_cache_entry
+{
+    char *name;
+    char *status_message;
+    char *short_id;
+    int short_id_size;
+};
+
+/**
+ * An entry in the friend index by name: the number of friends with the name
+ * and the sum of their friend numbers, which is the friend number itself
+ * when the name is unique. The sum lets a name be removed again without
+ * keeping a list of the friends sharing it.
+ */
+struct t_twc_friend_index_name
+{
+    int count;
+    int64_t friend_numbers;
+};
+
+/**
+ * Completion words for a profile's friends, sorted ignoring ASCII case so
+ * that all words with a given prefix are adjacent.
+ */
+struct t_twc_friend_words
+{
+    char **words;
+    size_t count;
+    size_t size;
+};
+
+void
+twc_friend_cache_init(struct t_twc_profile *profile);
+
+const char *
+twc_friend_cache_name(struct t_twc_profile *profile, int32_t friend_number);
+
+const char *
+twc_friend_cache_status_message(struct t_twc_profile *profile,
+                                int32_t friend_number);
+
+const char *
+twc_friend_cache_short_id(struct t_twc_profile *profile,
+                          int32_t friend_number);
+
+const char *
+twc_friend_cache_self_name(struct t_twc_profile *profile);
+
+int32_t
+twc_friend_cache_search_key(struct t_twc_profile *profile, const char *hex_key);
+
+int32_t
+twc_friend_cache_search_name(struct t_twc_profile *profile, const char *name,
+                             bool *ambiguous);
+
+const struct t_twc_friend_words *
+twc_friend_cache_name_words(struct t_twc_profile *profile);
+
+const struct t_twc_friend_words *
+twc_friend_cache_key_words(struct t_twc_profile *profile);
+
+size_t
+twc_friend_cache_words_match(const struct t_twc_friend_words *words,
+                             const char *prefix, size_t *count);
+
+void
+twc_friend_cache_set_name(struct t_twc_profile *profile, int32_t friend_number,
+                          const char *name);
+
+void
+twc_friend_cache_set_status_message(struct t_twc_profile *profile,
+                                    int32_t friend_number,
+                                    const char *status_message);
+
+void
+twc_friend_cache_invalidate(struct t_twc_profile *profile,
+                            int32_t friend_number);
+
+void
+twc_friend_cache_invalidate_self(struct t_twc_profile *profile);
+
+void
+twc_friend_cache_clear(struct t_twc_profile *profile);
+
+void
+twc_friend_cache_free_profile(struct t_twc_profile *profile);
+
+#endif /* TOX_WEECHAT_FRIEND_CACHE_H */
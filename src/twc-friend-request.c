@@ -22,7 +22,9 @@
 #include <tox/tox.h>
 #include <weechat/weechat-plugin.h>
 
+#include "twc-friend-cache.h"
 #include "twc-list.h"
+#include "twc-memory.h"
 #include "twc-profile.h"
 #include "twc-utils.h"
 #include "twc.h"
@@ -39,19 +41,20 @@ int
 twc_friend_request_add(struct t_twc_profile *profile, const uint8_t *client_id,
                        const char *message)
 {
-    size_t max_request_count = TWC_PROFILE_OPTION_INTEGER(
-        profile, TWC_PROFILE_OPTION_MAX_FRIEND_REQUESTS);
+    size_t max_request_count = profile->values.max_friend_requests;
     if (profile->friend_requests->count >= max_request_count)
         return -1;
 
     /* create a new request */
     struct t_twc_friend_request *request =
-        malloc(sizeof(struct t_twc_friend_request));
+        twc_memory_alloc(profile->memory, TWC_MEMORY_FRIEND_REQUESTS,
+                         sizeof(struct t_twc_friend_request));
     if (!request)
         return -2;
 
     request->profile = profile;
-    request->message = strdup(message);
+    request->message = twc_memory_strdup(profile->memory,
+                                         TWC_MEMORY_FRIEND_REQUESTS, message);
     memcpy(request->tox_id, client_id, TOX_PUBLIC_KEY_SIZE);
 
     if (!twc_list_item_new_data_add(profile->friend_requests, request))
@@ -67,7 +70,13 @@ bool
 twc_friend_request_accept(struct t_twc_friend_request *request)
 {
     TOX_ERR_FRIEND_ADD err = TOX_ERR_FRIEND_ADD_OK;
-    tox_friend_add_norequest(request->profile->tox, request->tox_id, &err);
+    uint32_t friend_number =
+        tox_friend_add_norequest(request->profile->tox, request->tox_id, &err);
+    if (err == TOX_ERR_FRIEND_ADD_OK)
+    {
+        /* the friend number may belong to a removed friend */
+        twc_friend_cache_invalidate(request->profile, friend_number);
+    }
     twc_friend_request_remove(request);
 
     return err == TOX_ERR_FRIEND_ADD_OK;
@@ -97,8 +106,8 @@ twc_friend_request_with_index(struct t_twc_profile *profile, int64_t index)
 void
 twc_friend_request_free(struct t_twc_friend_request *request)
 {
-    free(request->message);
-    free(request);
+    twc_memory_free(request->message);
+    twc_memory_free(request);
 }
 
 /**
@@ -111,5 +120,5 @@ twc_friend_request_free_list(struct t_twc_list *list)
     while ((request = twc_list_pop(list)))
         twc_friend_request_free(request);
 
-    free(list);
+    twc_list_free(list);
 }
@@ -27,6 +27,7 @@
 #endif /* TOXAV_ENABLED */
 
 #include "twc-list.h"
+#include "twc-memory.h"
 #include "twc-profile.h"
 #include "twc-utils.h"
 #include "twc.h"
@@ -44,11 +45,18 @@ twc_group_chat_invite_add(struct t_twc_profile *profile, int32_t friend_number,
 {
     /* create a new invite object */
     struct t_twc_group_chat_invite *invite =
-        malloc(sizeof(struct t_twc_group_chat_invite));
+        twc_memory_alloc(profile->memory, TWC_MEMORY_GROUP_INVITES,
+                         sizeof(struct t_twc_group_chat_invite));
     if (!invite)
         return -1;
 
-    uint8_t *data_copy = malloc(size);
+    uint8_t *data_copy =
+        twc_memory_alloc(profile->memory, TWC_MEMORY_GROUP_INVITES, size);
+    if (!data_copy)
+    {
+        twc_memory_free(invite);
+        return -1;
+    }
     memcpy(data_copy, data, size);
 
     invite->profile = profile;
@@ -57,9 +65,8 @@ twc_group_chat_invite_add(struct t_twc_profile *profile, int32_t friend_number,
     invite->data = data_copy;
     invite->data_size = size;
 
-    if (TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_AUTOJOIN))
-        invite->autojoin_delay = TWC_PROFILE_OPTION_INTEGER(
-            profile, TWC_PROFILE_OPTION_AUTOJOIN_DELAY);
+    if (profile->values.autojoin)
+        invite->autojoin_delay = profile->values.autojoin_delay;
     else
         invite->autojoin_delay = 0;
 
@@ -133,8 +140,8 @@ twc_group_chat_invite_with_index(struct t_twc_profile *profile, size_t index)
 void
 twc_group_chat_invite_free(struct t_twc_group_chat_invite *invite)
 {
-    free(invite->data);
-    free(invite);
+    twc_memory_free(invite->data);
+    twc_memory_free(invite);
 }
 
 /**
@@ -147,5 +154,5 @@ twc_group_chat_invite_free_list(struct t_twc_list *list)
     while ((invite = twc_list_pop(list)))
         twc_group_chat_invite_free(invite);
 
-    free(list);
+    twc_list_free(list);
 }
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tox/tox.h>
+#include <weechat/weechat-plugin.h>
+
+#include "twc-chat.h"
+#include "twc-memory.h"
+#include "twc-profile.h"
+#include "twc-utils.h"
+#include "twc.h"
+
+#include "twc-group-peer.h"
+
+/**
+ * Free a group peer; called by WeeChat when it is removed from a peer table.
+ */
+void
+twc_group_peer_free_callback(struct t_hashtable *hashtable, const void *key,
+                             void *value)
+{
+    struct t_twc_group_peer *peer = value;
+
+    twc_memory_free(peer->name);
+    twc_memory_free(peer->color);
+    twc_memory_free(peer);
+}
+
+/**
+ * Create an empty peer table for a group chat.
+ */
+struct t_hashtable *
+twc_group_peer_table_new()
+{
+    struct t_hashtable *peers = weechat_hashtable_new(
+        32, WEECHAT_HASHTABLE_STRING, WEECHAT_HASHTABLE_POINTER, NULL, NULL);
+    if (peers)
+    {
+        weechat_hashtable_set_pointer(peers, "callback_free_value",
+                                      twc_group_peer_free_callback);
+    }
+
+    return peers;
+}
+
+/**
+ * Get the hex-encoded public key of a group peer, used as its key in the
+ * peer table. Returns false if the peer does not exist.
+ */
+bool
+twc_group_peer_key(struct t_twc_chat *chat, uint32_t peer_number,
+                   char key[TOX_PUBLIC_KEY_SIZE * 2 + 1])
+{
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+    TOX_ERR_CONFERENCE_PEER_QUERY err = TOX_ERR_CONFERENCE_PEER_QUERY_OK;
+
+    tox_conference_peer_get_public_key(chat->profile->tox, chat->group_number,
+                                       peer_number, public_key, &err);
+    if (err != TOX_ERR_CONFERENCE_PEER_QUERY_OK)
+        return false;
+
+    twc_bin2hex(public_key, TOX_PUBLIC_KEY_SIZE, key);
+    return true;
+}
+
+/**
+ * Remove a group peer's nick from the nicklist. WeeChat refuses duplicate
+ * nicks, so another current peer with the same name may be missing from the
+ * nicklist; the first one found takes over the nick.
+ */
+void
+twc_group_peer_nick_remove(struct t_twc_chat *chat,
+                           struct t_twc_group_peer *peer)
+{
+    if (!peer->nick)
+        return;
+
+    weechat_nicklist_remove_nick(chat->buffer, peer->nick);
+    peer->nick = NULL;
+
+    for (uint32_t i = 0; i < chat->peer_count; ++i)
+    {
+        struct t_twc_group_peer *other = chat->peers_by_number[i];
+        if (other && other != peer && !other->nick &&
+            strcmp(other->name, peer->name) == 0)
+        {
+            other->nick = weechat_nicklist_add_nick(
+                chat->buffer, chat->nicklist_group, other->name, NULL, NULL,
+                NULL, 1);
+            return;
+        }
+    }
+}
+
+struct t_twc_group_peer_left_data
+{
+    struct t_twc_chat *chat;
+    struct t_weelist *keys;
+};
+
+/**
+ * Hashtable map callback announcing peers not seen in the latest peer list
+ * update, and collecting their keys for removal.
+ */
+void
+twc_group_peer_left_map_callback(void *data, struct t_hashtable *hashtable,
+                                 const void *key, const void *value)
+{
+    struct t_twc_group_peer_left_data *left = data;
+    struct t_twc_chat *chat = left->chat;
+    struct t_twc_group_peer *peer = (struct t_twc_group_peer *)value;
+
+    if (peer->generation == chat->peer_generation)
+        return;
+
+    weechat_printf(chat->buffer, "%s%s just left the group chat",
+                   weechat_prefix("quit"), peer->name);
+    twc_group_peer_nick_remove(chat, peer);
+
+    weechat_list_add(left->keys, key, WEECHAT_LIST_POS_END, NULL);
+}
+
+/**
+ * Update a group chat's peer table and nicklist from Tox, announcing peers
+ * that joined or left. Peers are matched by public key, so this is linear
+ * in the number of peers and works with duplicate names.
+ */
+void
+twc_group_peer_update_list(struct t_twc_chat *chat)
+{
+    TOX_ERR_CONFERENCE_PEER_QUERY err = TOX_ERR_CONFERENCE_PEER_QUERY_OK;
+    uint32_t npeers = tox_conference_peer_count(chat->profile->tox,
+                                                chat->group_number, &err);
+    if (err != TOX_ERR_CONFERENCE_PEER_QUERY_OK)
+        return;
+
+    unsigned int generation = ++(chat->peer_generation);
+
+    /* peer numbers change as peers leave, so the index is rebuilt */
+    struct t_twc_group_peer **by_number = twc_memory_realloc(
+        chat->profile->memory, TWC_MEMORY_NICKS, chat->peers_by_number,
+        (npeers ? npeers : 1) * sizeof(struct t_twc_group_peer *));
+    if (!by_number)
+        return;
+    chat->peers_by_number = by_number;
+    chat->peer_count = npeers;
+
+    /* mark current peers as seen, adding those that joined */
+    for (uint32_t i = 0; i < npeers; ++i)
+    {
+        char key[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+        by_number[i] = NULL;
+        if (!twc_group_peer_key(chat, i, key))
+            continue;
+
+        struct t_twc_group_peer *peer =
+            weechat_hashtable_get(chat->peers, key);
+        if (!peer)
+        {
+            peer = twc_memory_alloc(chat->profile->memory, TWC_MEMORY_NICKS,
+                                    sizeof(struct t_twc_group_peer));
+            if (!peer)
+                continue;
+
+            char *name = twc_get_peer_name_nt(chat->profile->tox,
+                                              chat->group_number, i);
+            peer->name = twc_memory_strdup(
+                chat->profile->memory, TWC_MEMORY_NICKS, name ? name : "");
+            free(name);
+            peer->color = NULL;
+            peer->flood.time = 0;
+            peer->flood.tokens = 0;
+            peer->flood_suppressed = 0;
+            /* WeeChat refuses duplicate nicks, so nick may be NULL */
+            peer->nick =
+                weechat_nicklist_add_nick(chat->buffer, chat->nicklist_group,
+                                          peer->name, NULL, NULL, NULL, 1);
+            weechat_hashtable_set(chat->peers, key, peer);
+
+            weechat_printf(chat->buffer, "%s%s just joined the group chat",
+                           weechat_prefix("join"), peer->name);
+        }
+
+        err = TOX_ERR_CONFERENCE_PEER_QUERY_OK;
+        peer->ours = tox_conference_peer_number_is_ours(
+            chat->profile->tox, chat->group_number, i, &err);
+        peer->ours = peer->ours && err == TOX_ERR_CONFERENCE_PEER_QUERY_OK;
+
+        peer->peer_number = i;
+        peer->generation = generation;
+        by_number[i] = peer;
+    }
+
+    /* remove peers that left */
+    struct t_twc_group_peer_left_data left = {chat, weechat_list_new()};
+    if (!left.keys)
+        return;
+
+    weechat_hashtable_map(chat->peers, twc_group_peer_left_map_callback,
+                          &left);
+
+    struct t_weelist_item *item;
+    for (item = weechat_list_get(left.keys, 0); item;
+         item = weechat_list_next(item))
+        weechat_hashtable_remove(chat->peers, weechat_list_string(item));
+
+    weechat_list_remove_all(left.keys);
+    weechat_list_free(left.keys);
+}
+
+/**
+ * Get a group peer by peer number, or NULL if it is not known.
+ */
+struct t_twc_group_peer *
+twc_group_peer_get(struct t_twc_chat *chat, uint32_t peer_number)
+{
+    if (peer_number >= chat->peer_count)
+        return NULL;
+
+    return chat->peers_by_number[peer_number];
+}
+
+/**
+ * Return the nick color of a group peer, looked up once per name.
+ */
+const char *
+twc_group_peer_color(struct t_twc_chat *chat, struct t_twc_group_peer *peer)
+{
+    if (peer->ours)
+        return weechat_color("chat_nick_self");
+
+    if (!peer->color)
+    {
+        const char *color = weechat_info_get("nick_color", peer->name);
+        peer->color = twc_memory_strdup(chat->profile->memory,
+                                        TWC_MEMORY_NICKS, color ? color : "");
+    }
+
+    return peer->color ? peer->color : "";
+}
+
+/**
+ * Handle a group peer changing their name.
+ */
+void
+twc_group_peer_rename(struct t_twc_chat *chat, uint32_t peer_number,
+                      const char *name)
+{
+    struct t_twc_group_peer *peer = twc_group_peer_get(chat, peer_number);
+    if (!peer)
+    {
+        /* we missed some events, fall back to full list update */
+        twc_group_peer_update_list(chat);
+        return;
+    }
+
+    if (!peer->ours)
+    {
+        weechat_printf(chat->buffer, "%s%s is now known as %s",
+                       weechat_prefix("network"), peer->name, name);
+    }
+
+    twc_group_peer_nick_remove(chat, peer);
+    peer->nick = weechat_nicklist_add_nick(
+        chat->buffer, chat->nicklist_group, name, NULL, NULL, NULL, 1);
+
+    twc_memory_free(peer->name);
+    twc_memory_free(peer->color);
+    peer->name =
+        twc_memory_strdup(chat->profile->memory, TWC_MEMORY_NICKS, name);
+    peer->color = NULL;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_GROUP_PEER_H
+#define TOX_WEECHAT_GROUP_PEER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "twc-flood.h"
+
+struct t_twc_chat;
+
+/**
+ * A peer in a group chat, stored in the chat's peer table keyed by the
+ * peer's hex-encoded public key, and indexed by peer number.
+ */
+struct t_twc_group_peer
+{
+    char *name;
+    char *color;
+    struct t_gui_nick *nick;
+    uint32_t peer_number;
+    bool ours;
+
+    /* last peer list update the peer was seen in */
+    unsigned int generation;
+
+    struct t_twc_flood_bucket flood;
+    unsigned int flood_suppressed;
+};
+
+struct t_hashtable *
+twc_group_peer_table_new();
+
+void
+twc_group_peer_update_list(struct t_twc_chat *chat);
+
+struct t_twc_group_peer *
+twc_group_peer_get(struct t_twc_chat *chat, uint32_t peer_number);
+
+const char *
+twc_group_peer_color(struct t_twc_chat *chat, struct t_twc_group_peer *peer);
+
+void
+twc_group_peer_rename(struct t_twc_chat *chat, uint32_t peer_number,
+                      const char *name);
+
+#endif /* TOX_WEECHAT_GROUP_PEER_H */
@@ -23,6 +23,7 @@
 #include <tox/tox.h>
 #include <weechat/weechat-plugin.h>
 
+#include "twc-friend-cache.h"
 #include "twc-profile.h"
 #include "twc-utils.h"
 #include "twc.h"
@@ -63,7 +64,7 @@ twc_bar_item_input_prompt(const void *pointer, void *data,
     if (!profile || !(profile->tox))
         return NULL;
 
-    return twc_get_self_name_nt(profile->tox);
+    return strdup(twc_friend_cache_self_name(profile));
 }
 
 char *
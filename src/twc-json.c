@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "twc-json.h"
+
+/* maximum nesting of arrays and objects skipped by twc_json_skip */
+#define TWC_JSON_MAX_DEPTH (64)
+
+/**
+ * Start parsing a NULL-terminated JSON text.
+ */
+void
+twc_json_init(struct t_twc_json *json, const char *text)
+{
+    json->pos = text;
+    json->error = false;
+}
+
+/**
+ * Skip whitespace and return the next character without consuming it, or
+ * '\0' at the end of the text or after an error.
+ */
+char
+twc_json_peek(struct t_twc_json *json)
+{
+    if (json->error)
+        return '\0';
+
+    while (*(json->pos) == ' ' || *(json->pos) == '\t' ||
+           *(json->pos) == '\n' || *(json->pos) == '\r')
+        ++(json->pos);
+
+    return *(json->pos);
+}
+
+/**
+ * Consume the character c if it is next. Returns true if it was.
+ */
+bool
+twc_json_accept(struct t_twc_json *json, char c)
+{
+    if (twc_json_peek(json) != c || c == '\0')
+        return false;
+
+    ++(json->pos);
+    return true;
+}
+
+/**
+ * Consume the character c, flagging an error if something else is next.
+ */
+bool
+twc_json_expect(struct t_twc_json *json, char c)
+{
+    if (twc_json_accept(json, c))
+        return true;
+
+    json->error = true;
+    return false;
+}
+
+/**
+ * Parse four hex digits of a \u escape. Returns -1 on error.
+ */
+long
+twc_json_hex4(const char *hex)
+{
+    long value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        char c = hex[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return -1;
+    }
+
+    return value;
+}
+
+/**
+ * Parse a string. Returns a newly allocated, NULL-terminated copy with
+ * escapes resolved, or NULL on error. Must be freed.
+ */
+char *
+twc_json_string(struct t_twc_json *json)
+{
+    if (!twc_json_expect(json, '"'))
+        return NULL;
+
+    /* escapes never make a string longer, so the raw length is enough */
+    const char *end = json->pos;
+    while (*end && *end != '"')
+        end += (*end == '\\' && end[1]) ? 2 : 1;
+    if (!*end)
+    {
+        json->error = true;
+        return NULL;
+    }
+
+    char *string = malloc(end - json->pos + 1);
+    if (!string)
+    {
+        json->error = true;
+        return NULL;
+    }
+
+    char *out = string;
+    const char *in = json->pos;
+    while (in < end)
+    {
+        if (*in != '\\')
+        {
+            *out++ = *in++;
+            continue;
+        }
+
+        ++in;
+        switch (*in++)
+        {
+            case '"':
+                *out++ = '"';
+                break;
+            case '\\':
+                *out++ = '\\';
+                break;
+            case '/':
+                *out++ = '/';
+                break;
+            case 'b':
+                *out++ = '\b';
+                break;
+            case 'f':
+                *out++ = '\f';
+                break;
+            case 'n':
+                *out++ = '\n';
+                break;
+            case 'r':
+                *out++ = '\r';
+                break;
+            case 't':
+                *out++ = '\t';
+                break;
+            case 'u':
+            {
+                long code = end - in >= 4 ? twc_json_hex4(in) : -1;
+                if (code < 0)
+                    goto error;
+                in += 4;
+
+                /* encode as UTF-8; surrogate pairs are not combined */
+                if (code < 0x80)
+                {
+                    *out++ = code;
+                }
+                else if (code >= 0xD800 && code < 0xE000)
+                {
+                    *out++ = '?';
+                }
+                else if (code < 0x800)
+                {
+                    *out++ = 0xC0 | (code >> 6);
+                    *out++ = 0x80 | (code & 0x3F);
+                }
+                else
+                {
+                    *out++ = 0xE0 | (code >> 12);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                }
+                break;
+            }
+            default:
+                goto error;
+        }
+    }
+    *out = '\0';
+
+    json->pos = end + 1;
+    return string;
+
+error:
+    free(string);
+    json->error = true;
+    return NULL;
+}
+
+/**
+ * Parse a number.
+ */
+bool
+twc_json_number(struct t_twc_json *json, double *number)
+{
+    char c = twc_json_peek(json);
+    if (c != '-' && (c < '0' || c > '9'))
+    {
+        json->error = true;
+        return false;
+    }
+
+    char *end;
+    *number = strtod(json->pos, &end);
+    if (end == json->pos)
+    {
+        json->error = true;
+        return false;
+    }
+
+    json->pos = end;
+    return true;
+}
+
+/**
+ * Consume a literal word such as true, false or null.
+ */
+bool
+twc_json_literal(struct t_twc_json *json, const char *literal)
+{
+    size_t length = strlen(literal);
+    if (twc_json_peek(json) != literal[0] ||
+        strncmp(json->pos, literal, length) != 0)
+    {
+        json->error = true;
+        return false;
+    }
+
+    json->pos += length;
+    return true;
+}
+
+/**
+ * Parse true or false.
+ */
+bool
+twc_json_boolean(struct t_twc_json *json, bool *boolean)
+{
+    if (twc_json_peek(json) == 't')
+        return (*boolean = twc_json_literal(json, "true"));
+
+    *boolean = false;
+    return twc_json_literal(json, "false");
+}
+
+/**
+ * Skip a value of any type, up to a maximum nesting depth.
+ */
+bool
+twc_json_skip_depth(struct t_twc_json *json, int depth)
+{
+    if (depth > TWC_JSON_MAX_DEPTH)
+    {
+        json->error = true;
+        return false;
+    }
+
+    double number;
+    bool boolean;
+    char *string;
+    switch (twc_json_peek(json))
+    {
+        case '{':
+            ++(json->pos);
+            if (twc_json_accept(json, '}'))
+                return true;
+            do
+            {
+                if (!(string = twc_json_string(json)))
+                    return false;
+                free(string);
+                if (!twc_json_expect(json, ':') ||
+                    !twc_json_skip_depth(json, depth + 1))
+                    return false;
+            } while (twc_json_accept(json, ','));
+            return twc_json_expect(json, '}');
+        case '[':
+            ++(json->pos);
+            if (twc_json_accept(json, ']'))
+                return true;
+            do
+            {
+                if (!twc_json_skip_depth(json, depth + 1))
+                    return false;
+            } while (twc_json_accept(json, ','));
+            return twc_json_expect(json, ']');
+        case '"':
+            if (!(string = twc_json_string(json)))
+                return false;
+            free(string);
+            return true;
+        case 't':
+        case 'f':
+            return twc_json_boolean(json, &boolean);
+        case 'n':
+            return twc_json_literal(json, "null");
+        default:
+            return twc_json_number(json, &number);
+    }
+}
+
+/**
+ * Skip a value of any type.
+ */
+bool
+twc_json_skip(struct t_twc_json *json)
+{
+    return twc_json_skip_depth(json, 0);
+}
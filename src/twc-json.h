@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_JSON_H
+#define TOX_WEECHAT_JSON_H
+
+#include <stdbool.h>
+
+/**
+ * A minimal pull parser for JSON text. Only what is needed to read
+ * well-formed data files is supported; the caller walks the document with
+ * the functions below and skips values it is not interested in.
+ */
+struct t_twc_json
+{
+    const char *pos;
+    bool error;
+};
+
+void
+twc_json_init(struct t_twc_json *json, const char *text);
+
+char
+twc_json_peek(struct t_twc_json *json);
+
+bool
+twc_json_accept(struct t_twc_json *json, char c);
+
+bool
+twc_json_expect(struct t_twc_json *json, char c);
+
+char *
+twc_json_string(struct t_twc_json *json);
+
+bool
+twc_json_number(struct t_twc_json *json, double *number);
+
+bool
+twc_json_boolean(struct t_twc_json *json, bool *boolean);
+
+bool
+twc_json_skip(struct t_twc_json *json);
+
+#endif /* TOX_WEECHAT_JSON_H */
@@ -17,6 +17,8 @@
  * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "twc-memory.h"
+
 #include "twc-list.h"
 
 /**
@@ -25,7 +27,8 @@
 struct t_twc_list *
 twc_list_new()
 {
-    struct t_twc_list *list = malloc(sizeof(struct t_twc_list));
+    struct t_twc_list *list =
+        twc_memory_alloc(NULL, TWC_MEMORY_LISTS, sizeof(struct t_twc_list));
 
     list->head = list->tail = NULL;
     list->count = 0;
@@ -39,7 +42,8 @@ twc_list_new()
 struct t_twc_list_item *
 twc_list_item_new()
 {
-    struct t_twc_list_item *item = malloc(sizeof(struct t_twc_list_item));
+    struct t_twc_list_item *item = twc_memory_alloc(
+        NULL, TWC_MEMORY_LISTS, sizeof(struct t_twc_list_item));
 
     return item;
 }
@@ -125,7 +129,7 @@ twc_list_remove(struct t_twc_list_item *item)
 
     void *data = item->data;
 
-    free(item);
+    twc_memory_free(item);
 
     return data;
 }
@@ -162,6 +166,18 @@ twc_list_pop(struct t_twc_list *list)
         return NULL;
 }
 
+/**
+ * Free a list and its items, but not the data associated with them.
+ */
+void
+twc_list_free(struct t_twc_list *list)
+{
+    while (list->head)
+        twc_list_remove(list->head);
+
+    twc_memory_free(list);
+}
+
 /**
  * Return the list item at an index, or NULL if it does not exist.
  */
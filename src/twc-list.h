@@ -44,6 +44,7 @@ struct t_twc_list_item
         struct t_twc_chat *chat;
         struct t_twc_queued_message *queued_message;
         struct t_twc_tfer_file *file;
+        struct t_twc_bootstrap_cache_node *bootstrap_node;
     };
 
     struct t_twc_list_item *next_item;
@@ -77,6 +78,9 @@ twc_list_remove_with_data(struct t_twc_list *list, const void *data);
 void *
 twc_list_pop(struct t_twc_list *list);
 
+void
+twc_list_free(struct t_twc_list *list);
+
 struct t_twc_list_item *
 twc_list_get(struct t_twc_list *list, size_t index);
 
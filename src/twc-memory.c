@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <weechat/weechat-plugin.h>
+
+#include "twc.h"
+
+#include "twc-memory.h"
+
+/* alignment of accounted allocations */
+#define TWC_MEMORY_ALIGN 16
+#define TWC_MEMORY_HEADER_SIZE                                                 \
+    ((sizeof(struct t_twc_memory_header) + TWC_MEMORY_ALIGN - 1) &             \
+     ~(size_t)(TWC_MEMORY_ALIGN - 1))
+
+/**
+ * Header in front of every accounted allocation. The data follows
+ * TWC_MEMORY_HEADER_SIZE bytes after the header.
+ */
+struct t_twc_memory_header
+{
+    struct t_twc_memory_usage *usage;
+    size_t size;
+    enum t_twc_memory_subsystem subsystem;
+
+#ifdef TWC_MEMORY_CHECK
+    const char *file;
+    int line;
+    struct t_twc_memory_header *prev;
+    struct t_twc_memory_header *next;
+#endif /* TWC_MEMORY_CHECK */
+};
+
+static const char *twc_memory_subsystem_names[TWC_MEMORY_NUM_SUBSYSTEMS] = {
+    [TWC_MEMORY_LISTS] = "lists",
+    [TWC_MEMORY_MESSAGE_QUEUES] = "message queues",
+    [TWC_MEMORY_TFER] = "file transfers",
+    [TWC_MEMORY_GROUP_INVITES] = "group invites",
+    [TWC_MEMORY_FRIEND_REQUESTS] = "friend requests",
+    [TWC_MEMORY_CHATS] = "chats",
+    [TWC_MEMORY_NICKS] = "nicks",
+};
+
+struct t_twc_memory_usage twc_memory_plugin = {.name = "plugin"};
+
+/* profile usages, including released ones that still have live memory */
+static struct t_twc_memory_usage *twc_memory_usages = NULL;
+
+/**
+ * Create the memory usage of a profile. Returns NULL on failure.
+ */
+struct t_twc_memory_usage *
+twc_memory_usage_new(const char *name)
+{
+    struct t_twc_memory_usage *usage = calloc(1, sizeof(*usage));
+    if (!usage)
+        return NULL;
+
+    usage->name = strdup(name);
+    if (!usage->name)
+    {
+        free(usage);
+        return NULL;
+    }
+
+    usage->next = twc_memory_usages;
+    twc_memory_usages = usage;
+
+    return usage;
+}
+
+/**
+ * Return the number of bytes still allocated in a usage.
+ */
+int64_t
+twc_memory_usage_live(struct t_twc_memory_usage *usage)
+{
+    int64_t live = 0;
+    for (int i = 0; i < TWC_MEMORY_NUM_SUBSYSTEMS; ++i)
+        live += usage->live[i];
+
+    return live;
+}
+
+/**
+ * Report the allocations still live in a usage as leaks. Only allocation
+ * sites are known when built with TWC_MEMORY_CHECK.
+ */
+void
+twc_memory_report_leaks(struct t_twc_memory_usage *usage)
+{
+#ifdef TWC_MEMORY_CHECK
+    for (struct t_twc_memory_header *header = usage->allocations_head; header;
+         header = header->next)
+    {
+        weechat_printf(NULL,
+                       "%s%s: memory leak in %s: %zu bytes of %s allocated at "
+                       "%s:%d",
+                       weechat_prefix("error"), weechat_plugin->name,
+                       usage->name, header->size,
+                       twc_memory_subsystem_names[header->subsystem],
+                       header->file, header->line);
+    }
+#else
+    for (int i = 0; i < TWC_MEMORY_NUM_SUBSYSTEMS; ++i)
+    {
+        if (usage->live[i])
+        {
+            weechat_printf(NULL,
+                           "%s%s: memory leak in %s: %" PRId64 " bytes of %s",
+                           weechat_prefix("error"), weechat_plugin->name,
+                           usage->name, usage->live[i],
+                           twc_memory_subsystem_names[i]);
+        }
+    }
+#endif /* TWC_MEMORY_CHECK */
+}
+
+/**
+ * Unlink a usage from the usage list and free it.
+ */
+void
+twc_memory_usage_free(struct t_twc_memory_usage *usage)
+{
+    for (struct t_twc_memory_usage **p = &twc_memory_usages; *p;
+         p = &(*p)->next)
+    {
+        if (*p == usage)
+        {
+            *p = usage->next;
+            break;
+        }
+    }
+
+    free(usage->name);
+    free(usage);
+}
+
+/**
+ * Release the memory usage of a profile that is being freed. All of the
+ * profile's accounted memory should have been freed by now; if not, the
+ * leaks are reported and the usage is kept so the leaked memory can still
+ * be freed and shows up in /tox memory.
+ */
+void
+twc_memory_usage_release(struct t_twc_memory_usage *usage)
+{
+    if (!usage)
+        return;
+
+    if (twc_memory_usage_live(usage))
+    {
+        twc_memory_report_leaks(usage);
+        usage->released = true;
+        return;
+    }
+
+    twc_memory_usage_free(usage);
+}
+
+/**
+ * Allocate memory accounted to a subsystem of a usage, the plugin's if
+ * usage is NULL. Must be freed with twc_memory_free. Returns NULL on
+ * failure.
+ */
+void *
+twc_memory_alloc_at(struct t_twc_memory_usage *usage,
+                    enum t_twc_memory_subsystem subsystem, size_t size,
+                    const char *file, int line)
+{
+    if (size > SIZE_MAX - TWC_MEMORY_HEADER_SIZE)
+        return NULL;
+
+    struct t_twc_memory_header *header = malloc(TWC_MEMORY_HEADER_SIZE + size);
+    if (!header)
+        return NULL;
+
+    if (!usage)
+        usage = &twc_memory_plugin;
+
+    header->usage = usage;
+    header->size = size;
+    header->subsystem = subsystem;
+
+#ifdef TWC_MEMORY_CHECK
+    header->file = file;
+    header->line = line;
+    header->prev = NULL;
+    header->next = usage->allocations_head;
+    if (header->next)
+        header->next->prev = header;
+    usage->allocations_head = header;
+#endif /* TWC_MEMORY_CHECK */
+
+    usage->live[subsystem] += size;
+    if (usage->live[subsystem] > usage->peak[subsystem])
+        usage->peak[subsystem] = usage->live[subsystem];
+    ++usage->allocations[subsystem];
+
+    return (char *)header + TWC_MEMORY_HEADER_SIZE;
+}
+
+/**
+ * Duplicate a string into accounted memory.
+ */
+char *
+twc_memory_strdup_at(struct t_twc_memory_usage *usage,
+                     enum t_twc_memory_subsystem subsystem, const char *str,
+                     const char *file, int line)
+{
+    return twc_memory_strndup_at(usage, subsystem, str, strlen(str), file,
+                                 line);
+}
+
+/**
+ * Duplicate at most length bytes of a string into accounted memory.
+ */
+char *
+twc_memory_strndup_at(struct t_twc_memory_usage *usage,
+                      enum t_twc_memory_subsystem subsystem, const char *str,
+                      size_t length, const char *file, int line)
+{
+    char *end = memchr(str, '\0', length);
+    if (end)
+        length = end - str;
+
+    if (length == SIZE_MAX)
+        return NULL;
+
+    char *copy = twc_memory_alloc_at(usage, subsystem, length + 1, file, line);
+    if (!copy)
+        return NULL;
+
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+/**
+ * Resize accounted memory, like realloc. A NULL ptr allocates new memory
+ * accounted to usage; otherwise the memory stays with its original usage.
+ */
+void *
+twc_memory_realloc_at(struct t_twc_memory_usage *usage,
+                      enum t_twc_memory_subsystem subsystem, void *ptr,
+                      size_t size, const char *file, int line)
+{
+    if (!ptr)
+        return twc_memory_alloc_at(usage, subsystem, size, file, line);
+
+    struct t_twc_memory_header *old_header =
+        (void *)((char *)ptr - TWC_MEMORY_HEADER_SIZE);
+    void *new_ptr = twc_memory_alloc_at(
+        old_header->usage, old_header->subsystem, size, file, line);
+    if (!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, old_header->size < size ? old_header->size : size);
+    twc_memory_free(ptr);
+
+    return new_ptr;
+}
+
+/**
+ * Free accounted memory. Does nothing if ptr is NULL.
+ */
+void
+twc_memory_free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    struct t_twc_memory_header *header =
+        (void *)((char *)ptr - TWC_MEMORY_HEADER_SIZE);
+    struct t_twc_memory_usage *usage = header->usage;
+
+    usage->live[header->subsystem] -= header->size;
+
+#ifdef TWC_MEMORY_CHECK
+    if (header->prev)
+        header->prev->next = header->next;
+    else
+        usage->allocations_head = header->next;
+    if (header->next)
+        header->next->prev = header->prev;
+#endif /* TWC_MEMORY_CHECK */
+
+    free(header);
+
+    /* the last leaked allocation of a freed profile is gone */
+    if (usage->released && !twc_memory_usage_live(usage))
+        twc_memory_usage_free(usage);
+}
+
+/**
+ * Print the memory usage of a usage to a buffer.
+ */
+void
+twc_memory_print_usage(struct t_gui_buffer *buffer,
+                       struct t_twc_memory_usage *usage)
+{
+    weechat_printf(buffer, "%s%s%s: %" PRId64 " bytes live",
+                   weechat_prefix("network"), usage->name,
+                   usage->released ? " (deleted)" : "",
+                   twc_memory_usage_live(usage));
+
+    for (int i = 0; i < TWC_MEMORY_NUM_SUBSYSTEMS; ++i)
+    {
+        if (!usage->allocations[i])
+            continue;
+
+        weechat_printf(buffer,
+                       "%s  %s: %" PRId64 " bytes live, %" PRId64
+                       " bytes peak, %" PRIu64 " allocations",
+                       weechat_prefix("network"), twc_memory_subsystem_names[i],
+                       usage->live[i], usage->peak[i], usage->allocations[i]);
+    }
+}
+
+/**
+ * Print accounted memory usage of the plugin and every profile to a buffer.
+ */
+void
+twc_memory_print(struct t_gui_buffer *buffer)
+{
+    twc_memory_print_usage(buffer, &twc_memory_plugin);
+    for (struct t_twc_memory_usage *usage = twc_memory_usages; usage;
+         usage = usage->next)
+        twc_memory_print_usage(buffer, usage);
+}
+
+/**
+ * Report memory that is still allocated when the plugin is unloaded, after
+ * all profiles have been freed.
+ */
+void
+twc_memory_free_all()
+{
+    twc_memory_report_leaks(&twc_memory_plugin);
+
+    /* usages left are released ones whose leaks have been reported */
+    while (twc_memory_usages)
+        twc_memory_usage_free(twc_memory_usages);
+}
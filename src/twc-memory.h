@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_MEMORY_H
+#define TOX_WEECHAT_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct t_gui_buffer;
+struct t_twc_memory_header;
+
+/**
+ * Subsystems whose heap allocations are accounted.
+ */
+enum t_twc_memory_subsystem
+{
+    TWC_MEMORY_LISTS = 0,
+    TWC_MEMORY_MESSAGE_QUEUES,
+    TWC_MEMORY_TFER,
+    TWC_MEMORY_GROUP_INVITES,
+    TWC_MEMORY_FRIEND_REQUESTS,
+    TWC_MEMORY_CHATS,
+    TWC_MEMORY_NICKS,
+
+    TWC_MEMORY_NUM_SUBSYSTEMS,
+};
+
+/**
+ * Live bytes, high-water marks and allocation counts per subsystem, for a
+ * profile or for the plugin as a whole.
+ */
+struct t_twc_memory_usage
+{
+    char *name;
+    int64_t live[TWC_MEMORY_NUM_SUBSYSTEMS];
+    int64_t peak[TWC_MEMORY_NUM_SUBSYSTEMS];
+    uint64_t allocations[TWC_MEMORY_NUM_SUBSYSTEMS];
+
+    /* the profile has been freed; kept only because memory leaked */
+    bool released;
+    struct t_twc_memory_usage *next;
+
+#ifdef TWC_MEMORY_CHECK
+    /* live allocations, for leak reports */
+    struct t_twc_memory_header *allocations_head;
+#endif /* TWC_MEMORY_CHECK */
+};
+
+/* allocations not tied to a profile */
+extern struct t_twc_memory_usage twc_memory_plugin;
+
+#define twc_memory_alloc(usage, subsystem, size)                               \
+    twc_memory_alloc_at(usage, subsystem, size, __FILE__, __LINE__)
+#define twc_memory_strdup(usage, subsystem, str)                               \
+    twc_memory_strdup_at(usage, subsystem, str, __FILE__, __LINE__)
+#define twc_memory_strndup(usage, subsystem, str, length)                      \
+    twc_memory_strndup_at(usage, subsystem, str, length, __FILE__, __LINE__)
+#define twc_memory_realloc(usage, subsystem, ptr, size)                        \
+    twc_memory_realloc_at(usage, subsystem, ptr, size, __FILE__, __LINE__)
+
+struct t_twc_memory_usage *
+twc_memory_usage_new(const char *name);
+
+void
+twc_memory_usage_release(struct t_twc_memory_usage *usage);
+
+void *
+twc_memory_alloc_at(struct t_twc_memory_usage *usage,
+                    enum t_twc_memory_subsystem subsystem, size_t size,
+                    const char *file, int line);
+
+char *
+twc_memory_strdup_at(struct t_twc_memory_usage *usage,
+                     enum t_twc_memory_subsystem subsystem, const char *str,
+                     const char *file, int line);
+
+char *
+twc_memory_strndup_at(struct t_twc_memory_usage *usage,
+                      enum t_twc_memory_subsystem subsystem, const char *str,
+                      size_t length, const char *file, int line);
+
+void *
+twc_memory_realloc_at(struct t_twc_memory_usage *usage,
+                      enum t_twc_memory_subsystem subsystem, void *ptr,
+                      size_t size, const char *file, int line);
+
+void
+twc_memory_free(void *ptr);
+
+void
+twc_memory_print(struct t_gui_buffer *buffer);
+
+void
+twc_memory_free_all();
+
+#endif /* TOX_WEECHAT_MEMORY_H */
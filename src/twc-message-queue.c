@@ -23,7 +23,10 @@
 #include <weechat/weechat-plugin.h>
 
 #include "twc-list.h"
+#include "twc-memory.h"
 #include "twc-profile.h"
+#include "twc-span.h"
+#include "twc-stats.h"
 #include "twc-utils.h"
 #include "twc.h"
 
@@ -64,13 +67,16 @@ twc_message_queue_add_friend_message(struct t_twc_profile *profile,
         int fit_len = twc_fit_utf8(message, TWC_MAX_FRIEND_MESSAGE_LENGTH);
 
         struct t_twc_queued_message *queued_message =
-            malloc(sizeof(struct t_twc_queued_message));
+            twc_memory_alloc(profile->memory, TWC_MEMORY_MESSAGE_QUEUES,
+                             sizeof(struct t_twc_queued_message));
 
         time_t rawtime = time(NULL);
-        queued_message->time = malloc(sizeof(struct tm));
+        queued_message->time = twc_memory_alloc(
+            profile->memory, TWC_MEMORY_MESSAGE_QUEUES, sizeof(struct tm));
         memcpy(queued_message->time, gmtime(&rawtime), sizeof(struct tm));
 
-        queued_message->message = strndup(message, fit_len);
+        queued_message->message = twc_memory_strndup(
+            profile->memory, TWC_MEMORY_MESSAGE_QUEUES, message, fit_len);
         queued_message->message_type = message_type;
 
         message += fit_len;
@@ -80,6 +86,7 @@ twc_message_queue_add_friend_message(struct t_twc_profile *profile,
         struct t_twc_list *message_queue =
             twc_message_queue_get_or_create(profile, friend_number);
         twc_list_item_new_data_add(message_queue, queued_message);
+        twc_stats_queue_add(profile->stats);
     }
 
     /* flush if friend is online */
@@ -96,6 +103,7 @@ void
 twc_message_queue_flush_friend(struct t_twc_profile *profile,
                                int32_t friend_number)
 {
+    TWC_SPAN_BEGIN(start);
     struct t_twc_list *message_queue =
         twc_message_queue_get_or_create(profile, friend_number);
     size_t index;
@@ -143,6 +151,11 @@ twc_message_queue_flush_friend(struct t_twc_profile *profile,
                 default:
                     err_str = "unknown error";
             }
+            if (err == TOX_ERR_FRIEND_SEND_MESSAGE_OK)
+                ++profile->stats->counters.messages_out;
+            else
+                twc_stats_send_error(profile->stats, false, err);
+
             if (err != TOX_ERR_FRIEND_SEND_MESSAGE_OK)
             {
                 struct t_twc_chat *friend_chat =
@@ -155,12 +168,15 @@ twc_message_queue_flush_friend(struct t_twc_profile *profile,
             }
             twc_message_queue_free_message(queued_message);
             item->queued_message = NULL;
+            --profile->stats->queue_depth;
         }
     }
 
     /* remove any now-empty items */
     while (message_queue->head && !(message_queue->head->queued_message))
         twc_list_remove(message_queue->head);
+
+    TWC_SPAN_END(start, "queue", "flush_friend", profile);
 }
 
 /**
@@ -169,9 +185,9 @@ twc_message_queue_flush_friend(struct t_twc_profile *profile,
 void
 twc_message_queue_free_message(struct t_twc_queued_message *message)
 {
-    free(message->time);
-    free(message->message);
-    free(message);
+    twc_memory_free(message->time);
+    twc_memory_free(message->message);
+    twc_memory_free(message);
 }
 
 void
@@ -184,7 +200,7 @@ twc_message_queue_free_map_callback(void *data, struct t_hashtable *hashtable,
     while ((message = twc_list_pop(message_queue)))
         twc_message_queue_free_message(message);
 
-    free(message_queue);
+    twc_list_free(message_queue);
 }
 
 /**
@@ -0,0 +1,544 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <tox/tox.h>
+#include <weechat/weechat-plugin.h>
+
+#include "twc-config.h"
+#include "twc-list.h"
+#include "twc-profile.h"
+#include "twc-stats.h"
+#include "twc.h"
+
+#include "twc-metrics.h"
+
+/**
+ * A client of the metrics socket that has not been sent all of the metrics
+ * yet.
+ */
+struct t_twc_metrics_client
+{
+    int fd;
+    char *data;
+    size_t size;
+    size_t position;
+    struct t_hook *hook;
+    struct t_twc_metrics_client *next;
+};
+
+static struct t_hook *twc_metrics_timer = NULL;
+static int twc_metrics_socket_fd = -1;
+static char *twc_metrics_socket_path = NULL;
+static struct t_hook *twc_metrics_socket_hook = NULL;
+static struct t_twc_metrics_client *twc_metrics_clients = NULL;
+
+/**
+ * Write a profile name as an OpenMetrics label value.
+ */
+void
+twc_metrics_write_label(FILE *file, const char *value)
+{
+    fputc('"', file);
+    for (const char *c = value; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c == '\n')
+            fputs("\\n", file);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * Write a sample for a profile, with an optional extra label (e.g.
+ * "direction=\"in\"").
+ */
+void
+twc_metrics_write_sample(FILE *file, const char *name,
+                         struct t_twc_profile *profile, const char *labels,
+                         uint64_t value)
+{
+    fprintf(file, "%s{profile=", name);
+    twc_metrics_write_label(file, profile->name);
+    fprintf(file, "%s%s} %" PRIu64 "\n", labels ? "," : "",
+            labels ? labels : "", value);
+}
+
+/**
+ * Return the number of friends of a profile that are online.
+ */
+uint64_t
+twc_metrics_friends_online(struct t_twc_profile *profile)
+{
+    if (!profile->tox)
+        return 0;
+
+    size_t friend_count = tox_self_get_friend_list_size(profile->tox);
+    if (!friend_count)
+        return 0;
+
+    uint32_t friend_numbers[friend_count];
+    tox_self_get_friend_list(profile->tox, friend_numbers);
+
+    uint64_t online = 0;
+    for (size_t i = 0; i < friend_count; ++i)
+    {
+        if (tox_friend_get_connection_status(profile->tox, friend_numbers[i],
+                                             NULL) != TOX_CONNECTION_NONE)
+            ++online;
+    }
+
+    return online;
+}
+
+/**
+ * Render the metrics of all profiles in the OpenMetrics text format.
+ * Returns a string that must be freed, or NULL on failure. Seconds are
+ * formatted from integer microseconds, as WeeChat may have set a locale
+ * with a decimal comma.
+ */
+char *
+twc_metrics_render(size_t *size)
+{
+    char *data = NULL;
+    FILE *file = open_memstream(&data, size);
+    if (!file)
+        return NULL;
+
+    size_t index;
+    struct t_twc_list_item *item;
+
+    fprintf(file, "# TYPE tox_profile_loaded gauge\n"
+                  "# HELP tox_profile_loaded Whether the profile is loaded.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        twc_metrics_write_sample(file, "tox_profile_loaded", item->profile,
+                                 NULL, item->profile->tox != NULL);
+    }
+
+    fprintf(file, "# TYPE tox_profile_online gauge\n"
+                  "# HELP tox_profile_online Whether the profile is connected "
+                  "to the Tox network.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        twc_metrics_write_sample(file, "tox_profile_online", item->profile,
+                                 NULL, item->profile->tox_online);
+    }
+
+    fprintf(file, "# TYPE tox_friends_online gauge\n"
+                  "# HELP tox_friends_online Number of friends online.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        uint64_t online = twc_metrics_friends_online(item->profile);
+        twc_metrics_write_sample(file, "tox_friends_online", item->profile,
+                                 NULL, online);
+    }
+
+    fprintf(file, "# TYPE tox_message_queue_depth gauge\n"
+                  "# HELP tox_message_queue_depth Messages waiting for "
+                  "friends to come online.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        twc_metrics_write_sample(file, "tox_message_queue_depth",
+                                 item->profile, NULL,
+                                 item->profile->stats->queue_depth);
+    }
+
+    fprintf(file, "# TYPE tox_messages counter\n"
+                  "# HELP tox_messages Messages received and sent since the "
+                  "profile was loaded.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        struct t_twc_stats_counters *counters = &item->profile->stats->counters;
+        twc_metrics_write_sample(file, "tox_messages_total", item->profile,
+                                 "direction=\"in\"", counters->messages_in);
+        twc_metrics_write_sample(file, "tox_messages_total", item->profile,
+                                 "direction=\"out\"", counters->messages_out);
+    }
+
+    fprintf(file, "# TYPE tox_file_transfer_bytes counter\n"
+                  "# HELP tox_file_transfer_bytes File transfer bytes "
+                  "received and sent since the profile was loaded.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        struct t_twc_stats_counters *counters = &item->profile->stats->counters;
+        twc_metrics_write_sample(file, "tox_file_transfer_bytes_total",
+                                 item->profile, "direction=\"in\"",
+                                 counters->file_bytes_in);
+        twc_metrics_write_sample(file, "tox_file_transfer_bytes_total",
+                                 item->profile, "direction=\"out\"",
+                                 counters->file_bytes_out);
+    }
+
+    fprintf(file, "# TYPE tox_callbacks counter\n"
+                  "# HELP tox_callbacks Tox callbacks run since the profile "
+                  "was loaded.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        twc_metrics_write_sample(file, "tox_callbacks_total", item->profile,
+                                 NULL,
+                                 item->profile->stats->counters.callbacks);
+    }
+
+    fprintf(file, "# TYPE tox_iterate_duration_seconds histogram\n"
+                  "# HELP tox_iterate_duration_seconds Time spent in "
+                  "tox_iterate.\n");
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        struct t_twc_stats_timing *timing =
+            &item->profile->stats->counters.iterate;
+        uint64_t cumulative = 0;
+        for (int i = 0; i < TWC_STATS_HISTOGRAM_BUCKETS; ++i)
+        {
+            char labels[32];
+            cumulative += timing->histogram[i];
+            if (i < TWC_STATS_HISTOGRAM_BUCKETS - 1)
+            {
+                /* durations are whole microseconds, and bucket i counts
+                 * those below 2 << i */
+                int64_t le = (INT64_C(2) << i) - 1;
+                snprintf(labels, sizeof(labels),
+                         "le=\"%" PRId64 ".%06" PRId64 "\"", le / 1000000,
+                         le % 1000000);
+            }
+            else
+            {
+                snprintf(labels, sizeof(labels), "le=\"+Inf\"");
+            }
+            twc_metrics_write_sample(file,
+                                     "tox_iterate_duration_seconds_bucket",
+                                     item->profile, labels, cumulative);
+        }
+
+        fprintf(file, "tox_iterate_duration_seconds_sum{profile=");
+        twc_metrics_write_label(file, item->profile->name);
+        fprintf(file, "} %" PRId64 ".%06" PRId64 "\n", timing->total / 1000000,
+                timing->total % 1000000);
+        twc_metrics_write_sample(file, "tox_iterate_duration_seconds_count",
+                                 item->profile, NULL, timing->count);
+    }
+
+    fprintf(file, "# EOF\n");
+
+    if (fclose(file) != 0)
+    {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+/**
+ * Write the metrics to the configured file. The metrics are written to a
+ * temporary file first and renamed into place, so readers never see a
+ * partial file.
+ */
+void
+twc_metrics_write_file()
+{
+    const char *path = weechat_config_string(twc_config_metrics_file);
+    if (!path || !path[0])
+        return;
+
+    const char *weechat_dir = weechat_info_get("weechat_dir", NULL);
+    char *expanded_path = weechat_string_replace(path, "%h", weechat_dir);
+    if (!expanded_path)
+        return;
+
+    size_t size;
+    char *data = twc_metrics_render(&size);
+    size_t temp_length = strlen(expanded_path) + sizeof(".tmp");
+    char *temp_path = malloc(temp_length);
+    if (data && temp_path)
+    {
+        snprintf(temp_path, temp_length, "%s.tmp", expanded_path);
+
+        FILE *file = fopen(temp_path, "w");
+        if (file)
+        {
+            bool ok = fwrite(data, 1, size, file) == size;
+            if (fclose(file) != 0)
+                ok = false;
+
+            if (!ok || rename(temp_path, expanded_path) != 0)
+                unlink(temp_path);
+        }
+    }
+
+    free(temp_path);
+    free(data);
+    free(expanded_path);
+}
+
+/**
+ * Timer callback that writes the metrics file.
+ */
+int
+twc_metrics_timer_cb(const void *pointer, void *data, int remaining_calls)
+{
+    twc_metrics_write_file();
+
+    return WEECHAT_RC_OK;
+}
+
+/**
+ * Close the connection to a metrics socket client and free it.
+ */
+void
+twc_metrics_client_free(struct t_twc_metrics_client *client)
+{
+    for (struct t_twc_metrics_client **p = &twc_metrics_clients; *p;
+         p = &(*p)->next)
+    {
+        if (*p == client)
+        {
+            *p = client->next;
+            break;
+        }
+    }
+
+    if (client->hook)
+        weechat_unhook(client->hook);
+    close(client->fd);
+    free(client->data);
+    free(client);
+}
+
+/**
+ * Send as much of the metrics to a client as its socket takes without
+ * blocking. Returns true if the client is done, i.e. has been sent
+ * everything or failed.
+ */
+bool
+twc_metrics_client_send(struct t_twc_metrics_client *client)
+{
+    while (client->position < client->size)
+    {
+        ssize_t sent = send(client->fd, client->data + client->position,
+                            client->size - client->position, MSG_NOSIGNAL);
+        if (sent < 0)
+            return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+
+        client->position += sent;
+    }
+
+    return true;
+}
+
+/**
+ * Callback for a metrics socket client that is ready for more data.
+ */
+int
+twc_metrics_client_cb(const void *pointer, void *data, int fd)
+{
+    struct t_twc_metrics_client *client = (void *)pointer;
+
+    if (twc_metrics_client_send(client))
+        twc_metrics_client_free(client);
+
+    return WEECHAT_RC_OK;
+}
+
+/**
+ * Callback for a connection to the metrics socket. Sends the metrics and
+ * closes the connection, waiting for the client to read them if they do not
+ * fit in the socket buffer.
+ */
+int
+twc_metrics_socket_cb(const void *pointer, void *data, int fd)
+{
+    int client_fd = accept(fd, NULL, NULL);
+    if (client_fd < 0)
+        return WEECHAT_RC_OK;
+
+    struct t_twc_metrics_client *client = calloc(1, sizeof(*client));
+    if (!client || fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        free(client);
+        close(client_fd);
+        return WEECHAT_RC_OK;
+    }
+
+    client->fd = client_fd;
+    client->next = twc_metrics_clients;
+    twc_metrics_clients = client;
+
+    client->data = twc_metrics_render(&client->size);
+    if (!client->data || twc_metrics_client_send(client))
+    {
+        twc_metrics_client_free(client);
+        return WEECHAT_RC_OK;
+    }
+
+    client->hook = weechat_hook_fd(client_fd, 0, 1, 0, twc_metrics_client_cb,
+                                   client, NULL);
+    if (!client->hook)
+        twc_metrics_client_free(client);
+
+    return WEECHAT_RC_OK;
+}
+
+/**
+ * Start listening on the configured metrics socket. An existing socket at
+ * the path is replaced, but any other file is left alone. Returns false and
+ * sets errno on failure.
+ */
+bool
+twc_metrics_socket_open()
+{
+    const char *path = weechat_config_string(twc_config_metrics_socket);
+    if (!path || !path[0])
+        return true;
+
+    const char *weechat_dir = weechat_info_get("weechat_dir", NULL);
+    char *expanded_path = weechat_string_replace(path, "%h", weechat_dir);
+    if (!expanded_path)
+        return false;
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(expanded_path) >= sizeof(address.sun_path))
+    {
+        free(expanded_path);
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address.sun_path, expanded_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        free(expanded_path);
+        return false;
+    }
+
+    /* replace a socket left behind by a previous session, but never
+     * anything else that happens to be at the configured path */
+    struct stat st;
+    if (lstat(expanded_path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            close(fd);
+            free(expanded_path);
+            errno = EEXIST;
+            return false;
+        }
+        unlink(expanded_path);
+    }
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, 8) < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        int error = errno;
+        close(fd);
+        free(expanded_path);
+        errno = error;
+        return false;
+    }
+
+    twc_metrics_socket_hook =
+        weechat_hook_fd(fd, 1, 0, 0, twc_metrics_socket_cb, NULL, NULL);
+    if (!twc_metrics_socket_hook)
+    {
+        close(fd);
+        unlink(expanded_path);
+        free(expanded_path);
+        return false;
+    }
+
+    twc_metrics_socket_fd = fd;
+    twc_metrics_socket_path = expanded_path;
+
+    return true;
+}
+
+/**
+ * Stop writing the metrics file and serving the metrics socket, and close
+ * all client connections.
+ */
+void
+twc_metrics_free()
+{
+    if (twc_metrics_timer)
+    {
+        weechat_unhook(twc_metrics_timer);
+        twc_metrics_timer = NULL;
+    }
+
+    while (twc_metrics_clients)
+        twc_metrics_client_free(twc_metrics_clients);
+
+    if (twc_metrics_socket_hook)
+    {
+        weechat_unhook(twc_metrics_socket_hook);
+        twc_metrics_socket_hook = NULL;
+    }
+    if (twc_metrics_socket_fd >= 0)
+    {
+        close(twc_metrics_socket_fd);
+        twc_metrics_socket_fd = -1;
+    }
+    if (twc_metrics_socket_path)
+    {
+        unlink(twc_metrics_socket_path);
+        free(twc_metrics_socket_path);
+        twc_metrics_socket_path = NULL;
+    }
+}
+
+/**
+ * (Re)start the metrics exporters according to the metrics options.
+ */
+void
+twc_metrics_reload()
+{
+    twc_metrics_free();
+
+    const char *path = weechat_config_string(twc_config_metrics_file);
+    if (path && path[0])
+    {
+        int interval = weechat_config_integer(twc_config_metrics_interval);
+        twc_metrics_timer = weechat_hook_timer(
+            interval * 1000, 0, 0, twc_metrics_timer_cb, NULL, NULL);
+        twc_metrics_write_file();
+    }
+
+    if (!twc_metrics_socket_open())
+    {
+        weechat_printf(NULL,
+                       "%s%s: could not listen on metrics socket \"%s\": %s",
+                       weechat_prefix("error"), weechat_plugin->name,
+                       weechat_config_string(twc_config_metrics_socket),
+                       strerror(errno));
+    }
+}
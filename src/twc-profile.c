@@ -19,6 +19,7 @@
 
 #include <inttypes.h>
 #include <pwd.h>
+#include <regex.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -32,17 +33,25 @@
 #include "twc-bootstrap.h"
 #include "twc-chat.h"
 #include "twc-config.h"
+#include "twc-friend-cache.h"
 #include "twc-friend-request.h"
 #include "twc-group-invite.h"
 #include "twc-list.h"
 #include "twc-message-queue.h"
+#include "twc-span.h"
+#include "twc-stats.h"
 #include "twc-tox-callbacks.h"
+#include "twc-trace.h"
 #include "twc-utils.h"
 #include "twc.h"
 
 #include "twc-profile.h"
 
 struct t_twc_list *twc_profiles = NULL;
+
+/* profiles by case-folded name, and loaded profiles by Tox object */
+struct t_hashtable *twc_profiles_by_name = NULL;
+struct t_hashtable *twc_profiles_by_tox = NULL;
 struct t_config_option *twc_config_profile_default[TWC_PROFILE_NUM_OPTIONS];
 
 /**
@@ -77,6 +86,7 @@ twc_profile_save_data_file(struct t_twc_profile *profile)
     if (!(profile->tox))
         return -1;
 
+    TWC_SPAN_BEGIN(start);
     char *full_path = twc_profile_expanded_data_path(profile);
 
     /* create containing folder if it doesn't exist */
@@ -98,11 +108,17 @@ twc_profile_save_data_file(struct t_twc_profile *profile)
 
     if (pw)
     {
-        pw = weechat_string_eval_expression(pw, NULL, NULL, NULL);
-        if (!tox_pass_encrypt(data, size, (uint8_t *)pw, strlen(pw), enc_data,
-                              NULL))
+        char *evaluated_pw =
+            weechat_string_eval_expression(pw, NULL, NULL, NULL);
+        bool encrypted = evaluated_pw &&
+                         tox_pass_encrypt(data, size, (uint8_t *)evaluated_pw,
+                                          strlen(evaluated_pw), enc_data, NULL);
+        free(evaluated_pw);
+        if (!encrypted)
         {
             weechat_printf(profile->buffer, "error encrypting data");
+            free(full_path);
+            TWC_SPAN_END(start, "profile", "save", profile);
             return -1;
         }
         d = enc_data;
@@ -111,16 +127,19 @@ twc_profile_save_data_file(struct t_twc_profile *profile)
 #endif /* TOXENCRYPTSAVE_ENABLED */
 
     /* save buffer to a file */
+    int rc = -1;
     FILE *file = fopen(full_path, "w");
     if (file)
     {
         size_t saved_size = fwrite(d, 1, size, file);
         fclose(file);
 
-        return saved_size == size;
+        rc = saved_size == size;
     }
+    free(full_path);
 
-    return -1;
+    TWC_SPAN_END(start, "profile", "save", profile);
+    return rc;
 }
 
 /**
@@ -145,6 +164,10 @@ void
 twc_profile_init()
 {
     twc_profiles = twc_list_new();
+    twc_profiles_by_name = weechat_hashtable_new(
+        32, WEECHAT_HASHTABLE_STRING, WEECHAT_HASHTABLE_POINTER, NULL, NULL);
+    twc_profiles_by_tox = weechat_hashtable_new(
+        32, WEECHAT_HASHTABLE_POINTER, WEECHAT_HASHTABLE_POINTER, NULL, NULL);
 }
 
 /**
@@ -155,9 +178,16 @@ twc_profile_new(const char *name)
 {
     struct t_twc_profile *profile = malloc(sizeof(struct t_twc_profile));
     profile->name = strdup(name);
+    profile->memory = twc_memory_usage_new(name);
 
     /* add to profile list */
     twc_list_item_new_data_add(twc_profiles, profile);
+    char *folded_name = twc_fold_case(name);
+    if (folded_name)
+    {
+        weechat_hashtable_set(twc_profiles_by_name, folded_name, profile);
+        free(folded_name);
+    }
 
     /* set up internal vars */
     profile->tox = NULL;
@@ -170,15 +200,69 @@ twc_profile_new(const char *name)
     profile->group_chat_invites = twc_list_new();
     profile->message_queues = weechat_hashtable_new(
         32, WEECHAT_HASHTABLE_INTEGER, WEECHAT_HASHTABLE_POINTER, NULL, NULL);
+    profile->connection_changes = weechat_hashtable_new(
+        32, WEECHAT_HASHTABLE_INTEGER, WEECHAT_HASHTABLE_INTEGER, NULL, NULL);
+    twc_friend_cache_init(profile);
+    profile->highlight = NULL;
+    profile->highlight_valid = false;
     profile->tfer = twc_tfer_new();
+    profile->stats = twc_stats_new();
+    profile->bootstrap_cache = twc_list_new();
+    profile->bootstrap_time = 0;
+    profile->bootstrap_attempts = 0;
+    profile->trace_file = NULL;
+    profile->trace_replay = NULL;
 
     /* set up config */
     twc_config_init_profile(profile);
+    twc_profile_refresh_values(profile);
     twc_tfer_update_downloading_path(profile);
 
     return profile;
 }
 
+/**
+ * Resolve the option values of a profile that are read on hot paths.
+ */
+void
+twc_profile_refresh_values(struct t_twc_profile *profile)
+{
+    struct t_twc_profile_values *values = &profile->values;
+
+    values->autoload =
+        TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_AUTOLOAD);
+    values->autojoin =
+        TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_AUTOJOIN);
+    values->autojoin_delay =
+        TWC_PROFILE_OPTION_INTEGER(profile, TWC_PROFILE_OPTION_AUTOJOIN_DELAY);
+    values->max_friend_requests = TWC_PROFILE_OPTION_INTEGER(
+        profile, TWC_PROFILE_OPTION_MAX_FRIEND_REQUESTS);
+    values->udp = TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_UDP);
+    values->logging =
+        TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_LOGGING);
+    values->bootstrap_nodes =
+        TWC_PROFILE_OPTION_INTEGER(profile, TWC_PROFILE_OPTION_BOOTSTRAP_NODES);
+    values->group_message_rate = TWC_PROFILE_OPTION_INTEGER(
+        profile, TWC_PROFILE_OPTION_GROUP_MESSAGE_RATE);
+    values->group_peer_message_rate = TWC_PROFILE_OPTION_INTEGER(
+        profile, TWC_PROFILE_OPTION_GROUP_PEER_MESSAGE_RATE);
+    values->callback_budget =
+        TWC_PROFILE_OPTION_INTEGER(profile, TWC_PROFILE_OPTION_CALLBACK_BUDGET);
+}
+
+/**
+ * Resolve the option values of all profiles, e.g. after a profile_default
+ * option changes.
+ */
+void
+twc_profile_refresh_values_all()
+{
+    size_t index;
+    struct t_twc_list_item *item;
+    twc_list_foreach (twc_profiles, index, item)
+        twc_profile_refresh_values(item->profile);
+}
+
 /**
  * Load Tox options from WeeChat configuration files into a Tox_Options struct.
  */
@@ -288,6 +372,8 @@ twc_profile_load(struct t_twc_profile *profile)
     if (profile->tox)
         return TWC_RC_ERROR;
 
+    twc_stats_load_start(profile->stats);
+
     if (!(profile->buffer))
     {
         /* create main buffer */
@@ -298,9 +384,7 @@ twc_profile_load(struct t_twc_profile *profile)
             return TWC_RC_ERROR;
 
         /* disable logging for buffer if option is off */
-        bool logging =
-            TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_LOGGING);
-        twc_set_buffer_logging(profile->buffer, logging);
+        twc_set_buffer_logging(profile->buffer, profile->values.logging);
 
         profile->nicklist_group =
             weechat_nicklist_add_group(profile->buffer, NULL, NULL, NULL, true);
@@ -340,7 +424,9 @@ twc_profile_load(struct t_twc_profile *profile)
     FILE *file = NULL;
     size_t data_size;
 
-    if (!(file = fopen(path, "r")))
+    file = fopen(path, "r");
+    free(path);
+    if (!file)
     {
         data_size = 0;
     }
@@ -366,6 +452,8 @@ twc_profile_load(struct t_twc_profile *profile)
         fclose(file);
     }
 
+    twc_stats_load_mark(profile->stats, TWC_STATS_LOAD_READ);
+
     options.savedata_data = data;
     options.savedata_length = data_size;
 
@@ -381,9 +469,14 @@ twc_profile_load(struct t_twc_profile *profile)
         {
             /* evaluate password option and duplicate as tox_*_decrypt wipes
              * it */
-            pw = weechat_string_eval_expression(pw, NULL, NULL, NULL);
-            if (!tox_pass_decrypt(data, data_size, (uint8_t *)pw, strlen(pw),
-                                  dec_data, NULL))
+            char *evaluated_pw =
+                weechat_string_eval_expression(pw, NULL, NULL, NULL);
+            bool decrypted =
+                evaluated_pw &&
+                tox_pass_decrypt(data, data_size, (uint8_t *)evaluated_pw,
+                                 strlen(evaluated_pw), dec_data, NULL);
+            free(evaluated_pw);
+            if (!decrypted)
             {
                 weechat_printf(profile->buffer,
                                "%scould not decrypt Tox data file, aborting",
@@ -404,6 +497,8 @@ twc_profile_load(struct t_twc_profile *profile)
     }
 #endif /* TOXENCRYPTSAVE_ENABLED */
 
+    twc_stats_load_mark(profile->stats, TWC_STATS_LOAD_DECRYPT);
+
     options.savedata_type =
         (data_size == 0) ? TOX_SAVEDATA_TYPE_NONE : TOX_SAVEDATA_TYPE_TOX_SAVE;
 
@@ -417,6 +512,9 @@ twc_profile_load(struct t_twc_profile *profile)
         return rc == TOX_ERR_NEW_MALLOC ? TWC_RC_ERROR_MALLOC : TWC_RC_ERROR;
     }
 
+    twc_stats_load_mark(profile->stats, TWC_STATS_LOAD_TOX_NEW);
+    weechat_hashtable_set(twc_profiles_by_tox, profile->tox, profile);
+
     if (data_size == 0)
     {
         /* no data file loaded, set default name */
@@ -437,37 +535,47 @@ twc_profile_load(struct t_twc_profile *profile)
                               strlen(default_name), NULL);
     }
 
-    /* bootstrap DHT
-     * TODO: add count to config */
-    int bootstrap_node_count = 5;
-    for (int i = 0; i < bootstrap_node_count; ++i)
-        twc_bootstrap_random_node(profile->tox);
+    /* bootstrap DHT, preferring nodes that worked last time */
+    twc_bootstrap_cache_load(profile);
+    twc_bootstrap_profile(profile);
+
+    twc_stats_load_mark(profile->stats, TWC_STATS_LOAD_BOOTSTRAP);
+    if (twc_span_enabled)
+    {
+        twc_span_add("profile", "load", profile,
+                     profile->stats->load_time[TWC_STATS_LOAD_START]);
+    }
 
     /* start tox_iterate loop */
     twc_do_timer_cb(profile, NULL, 0);
 
-    /* register Tox callbacks */
-    tox_callback_friend_message(profile->tox, twc_friend_message_callback);
+    /* register Tox callbacks, timed for the slow callback watchdog */
+    tox_callback_friend_message(profile->tox,
+                                twc_friend_message_callback_timed);
     tox_callback_friend_connection_status(profile->tox,
-                                          twc_connection_status_callback);
-    tox_callback_friend_name(profile->tox, twc_name_change_callback);
-    tox_callback_friend_status(profile->tox, twc_user_status_callback);
+                                          twc_connection_status_callback_timed);
+    tox_callback_friend_name(profile->tox, twc_name_change_callback_timed);
+    tox_callback_friend_status(profile->tox, twc_user_status_callback_timed);
     tox_callback_friend_status_message(profile->tox,
-                                       twc_status_message_callback);
-    tox_callback_friend_request(profile->tox, twc_friend_request_callback);
-    tox_callback_conference_invite(profile->tox, twc_group_invite_callback);
-    tox_callback_conference_message(profile->tox, twc_group_message_callback);
+                                       twc_status_message_callback_timed);
+    tox_callback_friend_request(profile->tox,
+                                twc_friend_request_callback_timed);
+    tox_callback_conference_invite(profile->tox,
+                                   twc_group_invite_callback_timed);
+    tox_callback_conference_message(profile->tox,
+                                    twc_group_message_callback_timed);
     tox_callback_conference_peer_list_changed(
-        profile->tox, twc_group_peer_list_changed_callback);
+        profile->tox, twc_group_peer_list_changed_callback_timed);
     tox_callback_conference_peer_name(profile->tox,
-                                      twc_group_peer_name_callback);
-    tox_callback_conference_title(profile->tox, twc_group_title_callback);
+                                      twc_group_peer_name_callback_timed);
+    tox_callback_conference_title(profile->tox, twc_group_title_callback_timed);
     tox_callback_file_recv_control(profile->tox,
-                                   twc_file_recv_control_callback);
+                                   twc_file_recv_control_callback_timed);
     tox_callback_file_chunk_request(profile->tox,
-                                    twc_file_chunk_request_callback);
-    tox_callback_file_recv(profile->tox, twc_file_recv_callback);
-    tox_callback_file_recv_chunk(profile->tox, twc_file_recv_chunk_callback);
+                                    twc_file_chunk_request_callback_timed);
+    tox_callback_file_recv(profile->tox, twc_file_recv_callback_timed);
+    tox_callback_file_recv_chunk(profile->tox,
+                                 twc_file_recv_chunk_callback_timed);
 
     return TWC_RC_OK;
 }
@@ -484,8 +592,16 @@ twc_profile_unload(struct t_twc_profile *profile)
 
     /* save and kill tox */
     int result = twc_profile_save_data_file(profile);
+    twc_bootstrap_cache_save(profile);
+    profile->bootstrap_time = 0;
+    profile->bootstrap_attempts = 0;
+    twc_trace_stop(profile);
+    twc_trace_replay_cancel(profile);
+    weechat_hashtable_remove(twc_profiles_by_tox, profile->tox);
     tox_kill(profile->tox);
     profile->tox = NULL;
+    weechat_hashtable_remove_all(profile->connection_changes);
+    twc_friend_cache_clear(profile);
 
     if (result == -1)
     {
@@ -515,8 +631,7 @@ twc_profile_autoload()
     struct t_twc_list_item *item;
     twc_list_foreach (twc_profiles, index, item)
     {
-        if (TWC_PROFILE_OPTION_BOOLEAN(item->profile,
-                                       TWC_PROFILE_OPTION_AUTOLOAD))
+        if (item->profile->values.autoload)
             twc_profile_load(item->profile);
     }
 }
@@ -550,21 +665,139 @@ twc_profile_set_online_status(struct t_twc_profile *profile, bool status)
     }
 }
 
+/**
+ * Append a highlight word to a regex pattern, escaping special characters.
+ * Returns the new end of the pattern.
+ */
+char *
+twc_profile_highlight_append(char *pattern, const char *word, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (strchr("\\.^$|()[]{}*+?", word[i]))
+            *pattern++ = '\\';
+        *pattern++ = word[i];
+    }
+
+    return pattern;
+}
+
+/**
+ * Compile a profile's highlight matcher from its own name and the words in
+ * its highlight_words option. Matches are case-insensitive whole words, as
+ * with weechat_string_has_highlight.
+ */
+void
+twc_profile_highlight_compile(struct t_twc_profile *profile)
+{
+    if (profile->highlight)
+    {
+        regfree(profile->highlight);
+        free(profile->highlight);
+        profile->highlight = NULL;
+    }
+    profile->highlight_valid = true;
+
+    const char *self_name = profile->tox ? twc_friend_cache_self_name(profile)
+                                         : "";
+    const char *extra_words = TWC_PROFILE_OPTION_STRING(
+        profile, TWC_PROFILE_OPTION_HIGHLIGHT_WORDS);
+    if (!extra_words)
+        extra_words = "";
+
+    /* every character may need escaping, and every word a separator */
+    size_t max_length = 2 * (strlen(self_name) + strlen(extra_words)) +
+                        strlen(extra_words) + 64;
+    char *pattern = malloc(max_length);
+    if (!pattern)
+        return;
+
+    char *end = pattern;
+    end += sprintf(end, "(^|[^[:alnum:]_])(");
+    bool empty = true;
+    if (self_name[0])
+    {
+        end = twc_profile_highlight_append(end, self_name, strlen(self_name));
+        empty = false;
+    }
+
+    const char *word = extra_words;
+    while (*word)
+    {
+        size_t length = strcspn(word, ",");
+        const char *next = word + length + (word[length] ? 1 : 0);
+
+        /* trim surrounding spaces */
+        while (length && *word == ' ')
+            ++word, --length;
+        while (length && word[length - 1] == ' ')
+            --length;
+
+        if (length)
+        {
+            if (!empty)
+                *end++ = '|';
+            end = twc_profile_highlight_append(end, word, length);
+            empty = false;
+        }
+
+        word = next;
+    }
+    sprintf(end, ")($|[^[:alnum:]_])");
+
+    if (!empty)
+    {
+        profile->highlight = malloc(sizeof(regex_t));
+        if (profile->highlight &&
+            regcomp(profile->highlight, pattern,
+                    REG_EXTENDED | REG_ICASE | REG_NOSUB) != 0)
+        {
+            free(profile->highlight);
+            profile->highlight = NULL;
+        }
+    }
+
+    free(pattern);
+}
+
+/**
+ * Mark a profile's highlight matcher as outdated, e.g. when its name or
+ * highlight words change. It is recompiled on next use.
+ */
+void
+twc_profile_highlight_invalidate(struct t_twc_profile *profile)
+{
+    profile->highlight_valid = false;
+}
+
+/**
+ * Check if a message highlights a profile.
+ */
+bool
+twc_profile_has_highlight(struct t_twc_profile *profile, const char *message)
+{
+    if (!profile->highlight_valid)
+        twc_profile_highlight_compile(profile);
+
+    return profile->highlight &&
+           regexec(profile->highlight, message, 0, NULL, 0) == 0;
+}
+
 /**
  * Return the profile with a certain name. Case insensitive.
  */
 struct t_twc_profile *
 twc_profile_search_name(const char *name)
 {
-    size_t index;
-    struct t_twc_list_item *item;
-    twc_list_foreach (twc_profiles, index, item)
-    {
-        if (weechat_strcasecmp(item->profile->name, name) == 0)
-            return item->profile;
-    }
+    char *folded_name = twc_fold_case(name);
+    if (!folded_name)
+        return NULL;
 
-    return NULL;
+    struct t_twc_profile *profile =
+        weechat_hashtable_get(twc_profiles_by_name, folded_name);
+    free(folded_name);
+
+    return profile;
 }
 
 /**
@@ -601,14 +834,7 @@ twc_profile_search_buffer(struct t_gui_buffer *buffer)
 struct t_twc_profile *
 twc_profile_search_tox(struct Tox *tox)
 {
-    size_t profile_index;
-    struct t_twc_list_item *profile_item;
-    twc_list_foreach (twc_profiles, profile_index, profile_item)
-    {
-        if (profile_item->profile->tox == tox)
-            return profile_item->profile;
-    }
-    return NULL;
+    return weechat_hashtable_get(twc_profiles_by_tox, tox);
 }
 
 /**
@@ -657,20 +883,27 @@ twc_profile_set_logging(struct t_twc_profile *profile, bool logging)
 
 /**
  * Delete a profile. Unloads, frees and deletes everything. If delete_data is
- * true, Tox data on disk is also deleted.
+ * true, Tox data and the bootstrap node cache on disk are also deleted.
  */
 void
 twc_profile_delete(struct t_twc_profile *profile, bool delete_data)
 {
     char *data_path = twc_profile_expanded_data_path(profile);
 
+    /* unloading saves the data file and the node cache, whose paths are
+     * derived from the options freed below */
+    twc_profile_unload(profile);
+    if (delete_data)
+        twc_bootstrap_cache_delete(profile);
+
     for (size_t i = 0; i < TWC_PROFILE_NUM_OPTIONS; ++i)
         weechat_config_option_free(profile->options[i]);
 
     twc_profile_free(profile);
 
-    if (delete_data)
+    if (delete_data && data_path)
         unlink(data_path);
+    free(data_path);
 }
 
 /**
@@ -702,11 +935,28 @@ twc_profile_free(struct t_twc_profile *profile)
     twc_group_chat_invite_free_list(profile->group_chat_invites);
     twc_tfer_free(profile->tfer);
     twc_message_queue_free_profile(profile);
-    free(profile->name);
-    free(profile);
+    weechat_hashtable_free(profile->connection_changes);
+    twc_friend_cache_free_profile(profile);
+    if (profile->highlight)
+    {
+        regfree(profile->highlight);
+        free(profile->highlight);
+    }
+    twc_stats_free(profile->stats);
+    twc_bootstrap_cache_free_list(profile->bootstrap_cache);
+    twc_memory_usage_release(profile->memory);
 
-    /* remove from list */
+    /* remove from list and registry */
     twc_list_remove_with_data(twc_profiles, profile);
+    char *folded_name = twc_fold_case(profile->name);
+    if (folded_name)
+    {
+        weechat_hashtable_remove(twc_profiles_by_name, folded_name);
+        free(folded_name);
+    }
+
+    free(profile->name);
+    free(profile);
 }
 
 /**
@@ -719,5 +969,7 @@ twc_profile_free_all()
     while ((profile = twc_list_pop(twc_profiles)))
         twc_profile_free(profile);
 
-    free(twc_profiles);
+    twc_list_free(twc_profiles);
+    weechat_hashtable_free(twc_profiles_by_name);
+    weechat_hashtable_free(twc_profiles_by_tox);
 }
@@ -20,11 +20,16 @@
 #ifndef TOX_WEECHAT_PROFILE_H
 #define TOX_WEECHAT_PROFILE_H
 
+#include <regex.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #include <tox/tox.h>
 #include <weechat/weechat-plugin.h>
 
+#include "twc-friend-cache.h"
+#include "twc-memory.h"
+#include "twc-stats.h"
 #include "twc-tfer.h"
 
 enum t_twc_profile_option
@@ -42,14 +47,38 @@ enum t_twc_profile_option
     TWC_PROFILE_OPTION_PASSPHRASE,
     TWC_PROFILE_OPTION_LOGGING,
     TWC_PROFILE_OPTION_DOWNLOADING_PATH,
+    TWC_PROFILE_OPTION_BOOTSTRAP_NODES,
+    TWC_PROFILE_OPTION_HIGHLIGHT_WORDS,
+    TWC_PROFILE_OPTION_GROUP_MESSAGE_RATE,
+    TWC_PROFILE_OPTION_GROUP_PEER_MESSAGE_RATE,
+    TWC_PROFILE_OPTION_CALLBACK_BUDGET,
 
     TWC_PROFILE_NUM_OPTIONS,
 };
 
+/**
+ * Profile option values read on hot paths, resolved from the profile and
+ * profile_default options and refreshed whenever either of them changes.
+ */
+struct t_twc_profile_values
+{
+    bool autoload;
+    bool autojoin;
+    int autojoin_delay;
+    int max_friend_requests;
+    bool udp;
+    bool logging;
+    int bootstrap_nodes;
+    int group_message_rate;
+    int group_peer_message_rate;
+    int callback_budget;
+};
+
 struct t_twc_profile
 {
     char *name;
     struct t_config_option *options[TWC_PROFILE_NUM_OPTIONS];
+    struct t_twc_profile_values values;
 
     struct Tox *tox;
     int tox_online;
@@ -62,8 +91,32 @@ struct t_twc_profile
     struct t_twc_list *friend_requests;
     struct t_twc_list *group_chat_invites;
     struct t_hashtable *message_queues;
+    struct t_hashtable *connection_changes;
+    struct t_hashtable *friend_cache;
+    char *self_name;
+    struct t_hashtable *friend_index_keys;
+    struct t_hashtable *friend_index_names;
+    int friend_index_short_id_size;
+    bool friend_index_valid;
+    struct t_twc_friend_words friend_name_words;
+    struct t_twc_friend_words friend_key_words;
+    int friend_words_short_id_size;
+    bool friend_words_valid;
+
+    regex_t *highlight;
+    bool highlight_valid;
 
     struct t_twc_tfer *tfer;
+    struct t_twc_stats *stats;
+    struct t_twc_memory_usage *memory;
+
+    struct t_twc_list *bootstrap_cache;
+    int64_t bootstrap_time;
+    int bootstrap_attempts;
+
+    FILE *trace_file;
+    int64_t trace_start;
+    struct t_twc_trace_replay *trace_replay;
 };
 
 extern struct t_twc_list *twc_profiles;
@@ -109,6 +162,9 @@ twc_profile_init();
 struct t_twc_profile *
 twc_profile_new(const char *name);
 
+char *
+twc_profile_expanded_data_path(struct t_twc_profile *profile);
+
 enum t_twc_rc
 twc_profile_load(struct t_twc_profile *profile);
 
@@ -121,12 +177,24 @@ twc_profile_autoload();
 int
 twc_profile_save_data_file(struct t_twc_profile *profile);
 
+void
+twc_profile_refresh_values(struct t_twc_profile *profile);
+
+void
+twc_profile_refresh_values_all();
+
 void
 twc_profile_refresh_online_status(struct t_twc_profile *profile);
 
 void
 twc_profile_set_online_status(struct t_twc_profile *profile, bool online);
 
+void
+twc_profile_highlight_invalidate(struct t_twc_profile *profile);
+
+bool
+twc_profile_has_highlight(struct t_twc_profile *profile, const char *message);
+
 struct t_twc_profile *
 twc_profile_search_name(const char *name);
 
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <weechat/weechat-plugin.h>
+
+#include "twc.h"
+
+#include "twc-scratch.h"
+
+/* size of the arena block, enough for a few dozen maximum length messages */
+#define TWC_SCRATCH_SIZE (64 * 1024)
+/* alignment of arena allocations */
+#define TWC_SCRATCH_ALIGN 16
+
+/**
+ * Header of an allocation that did not fit in the arena block, freed on
+ * reset. The data follows TWC_SCRATCH_ALIGN bytes after the header.
+ */
+struct t_twc_scratch_fallback
+{
+    struct t_twc_scratch_fallback *next;
+};
+
+struct t_twc_scratch_stats twc_scratch_stats = {0};
+
+static char *twc_scratch_block = NULL;
+static size_t twc_scratch_used = 0;
+static size_t twc_scratch_fallback_bytes = 0;
+static struct t_twc_scratch_fallback *twc_scratch_fallbacks = NULL;
+
+/**
+ * Allocate memory that stays valid until the next twc_scratch_reset, which
+ * happens after every Tox iteration. Meant for short-lived strings in Tox
+ * callbacks. Returns NULL on failure.
+ */
+void *
+twc_scratch_alloc(size_t size)
+{
+    size_t aligned =
+        (size + TWC_SCRATCH_ALIGN - 1) & ~(size_t)(TWC_SCRATCH_ALIGN - 1);
+
+    if (!twc_scratch_block)
+        twc_scratch_block = malloc(TWC_SCRATCH_SIZE);
+
+    if (twc_scratch_block && aligned >= size &&
+        aligned <= TWC_SCRATCH_SIZE - twc_scratch_used)
+    {
+        void *memory = twc_scratch_block + twc_scratch_used;
+        twc_scratch_used += aligned;
+        ++twc_scratch_stats.allocations;
+        return memory;
+    }
+
+    /* out of arena space, fall back to malloc */
+    if (size > SIZE_MAX - TWC_SCRATCH_ALIGN)
+        return NULL;
+
+    struct t_twc_scratch_fallback *fallback = malloc(TWC_SCRATCH_ALIGN + size);
+    if (!fallback)
+        return NULL;
+
+    fallback->next = twc_scratch_fallbacks;
+    twc_scratch_fallbacks = fallback;
+    twc_scratch_fallback_bytes += size;
+    ++twc_scratch_stats.fallbacks;
+
+    return (char *)fallback + TWC_SCRATCH_ALIGN;
+}
+
+/**
+ * Return a null-terminated scratch copy of str, valid until the next
+ * twc_scratch_reset.
+ */
+char *
+twc_scratch_null_terminate(const uint8_t *str, size_t length)
+{
+    if (length == SIZE_MAX)
+        return NULL;
+
+    char *str_null = twc_scratch_alloc(length + 1);
+    if (str_null)
+    {
+        memcpy(str_null, str, length);
+        str_null[length] = 0;
+    }
+
+    return str_null;
+}
+
+/**
+ * Release all scratch allocations. Keeps the arena block for reuse.
+ */
+void
+twc_scratch_reset()
+{
+    size_t used = twc_scratch_used + twc_scratch_fallback_bytes;
+    if (used > twc_scratch_stats.peak)
+        twc_scratch_stats.peak = used;
+
+    while (twc_scratch_fallbacks)
+    {
+        struct t_twc_scratch_fallback *next = twc_scratch_fallbacks->next;
+        free(twc_scratch_fallbacks);
+        twc_scratch_fallbacks = next;
+    }
+
+    twc_scratch_used = 0;
+    twc_scratch_fallback_bytes = 0;
+    ++twc_scratch_stats.resets;
+}
+
+/**
+ * Print scratch arena counters to a buffer.
+ */
+void
+twc_scratch_print(struct t_gui_buffer *buffer)
+{
+    weechat_printf(buffer,
+                   "%sScratch memory: %" PRIu64 " allocations, %" PRIu64
+                   " malloc fallbacks, %" PRIu64 " resets, peak %zu of %d "
+                   "bytes",
+                   weechat_prefix("network"), twc_scratch_stats.allocations,
+                   twc_scratch_stats.fallbacks, twc_scratch_stats.resets,
+                   twc_scratch_stats.peak, TWC_SCRATCH_SIZE);
+}
+
+/**
+ * Free the scratch arena.
+ */
+void
+twc_scratch_free()
+{
+    twc_scratch_reset();
+    free(twc_scratch_block);
+    twc_scratch_block = NULL;
+}
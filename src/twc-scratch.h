@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_SCRATCH_H
+#define TOX_WEECHAT_SCRATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct t_gui_buffer;
+
+/**
+ * Allocation counters for the scratch arena, since the plugin was loaded.
+ */
+struct t_twc_scratch_stats
+{
+    /* allocations served from the arena block */
+    uint64_t allocations;
+    /* allocations that did not fit and fell back to malloc */
+    uint64_t fallbacks;
+    /* number of times the arena was reset */
+    uint64_t resets;
+    /* most bytes used by the arena between two resets */
+    size_t peak;
+};
+
+extern struct t_twc_scratch_stats twc_scratch_stats;
+
+void *
+twc_scratch_alloc(size_t size);
+
+char *
+twc_scratch_null_terminate(const uint8_t *str, size_t length);
+
+void
+twc_scratch_reset();
+
+void
+twc_scratch_print(struct t_gui_buffer *buffer);
+
+void
+twc_scratch_free();
+
+#endif /* TOX_WEECHAT_SCRATCH_H */
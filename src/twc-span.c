@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <weechat/weechat-plugin.h>
+
+#include "twc-profile.h"
+#include "twc-stats.h"
+#include "twc.h"
+
+#include "twc-span.h"
+
+bool twc_span_enabled = false;
+
+/* ring buffer of recorded spans; the oldest are overwritten when full */
+static struct t_twc_span *twc_span_ring = NULL;
+static size_t twc_span_capacity = 0;
+static uint64_t twc_span_count = 0;
+
+/* names of the profiles spans were recorded for; thread n is
+ * twc_span_threads[n - 1], thread 0 the plugin itself */
+static char **twc_span_threads = NULL;
+static size_t twc_span_thread_count = 0;
+
+/**
+ * Start recording spans into a ring buffer of the given number of spans,
+ * discarding any spans recorded before. Returns false on failure.
+ */
+bool
+twc_span_start(size_t capacity)
+{
+    if (!capacity || capacity > SIZE_MAX / sizeof(struct t_twc_span))
+        return false;
+
+    struct t_twc_span *ring = malloc(capacity * sizeof(struct t_twc_span));
+    if (!ring)
+        return false;
+
+    twc_span_free();
+    twc_span_ring = ring;
+    twc_span_capacity = capacity;
+    twc_span_enabled = true;
+
+    return true;
+}
+
+/**
+ * Stop recording spans. Recorded spans are kept until dumped or freed.
+ */
+void
+twc_span_stop()
+{
+    twc_span_enabled = false;
+}
+
+/**
+ * Return the thread number for a profile, registering its name if it is
+ * new. Returns 0 if there is no profile or it can not be registered.
+ */
+uint32_t
+twc_span_thread(struct t_twc_profile *profile)
+{
+    if (!profile)
+        return 0;
+
+    for (size_t i = 0; i < twc_span_thread_count; ++i)
+    {
+        if (strcmp(twc_span_threads[i], profile->name) == 0)
+            return i + 1;
+    }
+
+    char **threads = realloc(twc_span_threads, (twc_span_thread_count + 1) *
+                                                   sizeof(char *));
+    if (!threads)
+        return 0;
+    twc_span_threads = threads;
+
+    char *name = strdup(profile->name);
+    if (!name)
+        return 0;
+    twc_span_threads[twc_span_thread_count++] = name;
+
+    return twc_span_thread_count;
+}
+
+/**
+ * Record a span that started at the given time, in microseconds, and ends
+ * now. Spans started while recording was disabled are ignored.
+ */
+void
+twc_span_add(const char *category, const char *name,
+             struct t_twc_profile *profile, int64_t start)
+{
+    if (!twc_span_ring || !start)
+        return;
+
+    struct t_twc_span *span =
+        &twc_span_ring[twc_span_count % twc_span_capacity];
+    span->category = category;
+    span->name = name;
+    span->start = start;
+    span->duration = twc_stats_time() - start;
+    span->thread = twc_span_thread(profile);
+    ++twc_span_count;
+}
+
+/**
+ * Write a string to a file as a JSON string.
+ */
+void
+twc_span_write_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)str; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * Write the recorded spans, oldest first, to a file in the Chrome trace
+ * event format, which chrome://tracing and Perfetto can open. "%h" in the
+ * path is replaced by the WeeChat home folder. Stores the number of spans
+ * written in count. Returns false if the file could not be written.
+ */
+bool
+twc_span_dump(const char *path, size_t *count)
+{
+    const char *weechat_dir = weechat_info_get("weechat_dir", NULL);
+    char *expanded_path = weechat_string_replace(path, "%h", weechat_dir);
+    if (!expanded_path)
+        return false;
+
+    FILE *file = fopen(expanded_path, "w");
+    free(expanded_path);
+    if (!file)
+        return false;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    /* name the threads after their profiles */
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"tid\":0,\"args\":{\"name\":\"tox\"}}");
+    for (size_t i = 0; i < twc_span_thread_count; ++i)
+    {
+        fprintf(file,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%zu,\"args\":{\"name\":",
+                i + 1);
+        twc_span_write_string(file, twc_span_threads[i]);
+        fprintf(file, "}}");
+    }
+
+    uint64_t first = twc_span_count > twc_span_capacity
+                         ? twc_span_count - twc_span_capacity
+                         : 0;
+    for (uint64_t i = first; i < twc_span_count; ++i)
+    {
+        struct t_twc_span *span = &twc_span_ring[i % twc_span_capacity];
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                "\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"pid\":1,"
+                "\"tid\":%" PRIu32 "}",
+                span->name, span->category, span->start, span->duration,
+                span->thread);
+    }
+
+    fprintf(file, "\n]}\n");
+    *count = twc_span_count - first;
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0)
+        ok = false;
+
+    return ok;
+}
+
+/**
+ * Stop recording spans and free all recorded spans.
+ */
+void
+twc_span_free()
+{
+    twc_span_enabled = false;
+
+    free(twc_span_ring);
+    twc_span_ring = NULL;
+    twc_span_capacity = 0;
+    twc_span_count = 0;
+
+    for (size_t i = 0; i < twc_span_thread_count; ++i)
+        free(twc_span_threads[i]);
+    free(twc_span_threads);
+    twc_span_threads = NULL;
+    twc_span_thread_count = 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_SPAN_H
+#define TOX_WEECHAT_SPAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "twc-stats.h"
+
+struct t_twc_profile;
+
+/**
+ * A timed piece of plugin activity. Names and categories are string
+ * literals; the thread identifies the profile the work was done for.
+ */
+struct t_twc_span
+{
+    const char *category;
+    const char *name;
+    int64_t start;
+    int64_t duration;
+    uint32_t thread;
+};
+
+/* number of spans kept by default */
+#define TWC_SPAN_DEFAULT_CAPACITY 65536
+
+extern bool twc_span_enabled;
+
+/* start timing a span, if span recording is enabled */
+#define TWC_SPAN_BEGIN(start)                                                  \
+    int64_t start = twc_span_enabled ? twc_stats_time() : 0
+
+/* finish a span started with TWC_SPAN_BEGIN */
+#define TWC_SPAN_END(start, category, name, profile)                           \
+    do                                                                         \
+    {                                                                          \
+        if (twc_span_enabled)                                                  \
+            twc_span_add(category, name, profile, start);                      \
+    } while (0)
+
+bool
+twc_span_start(size_t capacity);
+
+void
+twc_span_stop();
+
+void
+twc_span_add(const char *category, const char *name,
+             struct t_twc_profile *profile, int64_t start);
+
+bool
+twc_span_dump(const char *path, size_t *count);
+
+void
+twc_span_free();
+
+#endif /* TOX_WEECHAT_SPAN_H */
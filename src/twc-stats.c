@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <tox/tox.h>
+#include <weechat/weechat-plugin.h>
+
+#include "twc-list.h"
+#include "twc-profile.h"
+#include "twc.h"
+
+#include "twc-stats.h"
+
+static const char *twc_stats_load_phase_names[TWC_STATS_NUM_LOAD_PHASES] = {
+    "start", "read", "decrypt", "tox_new", "bootstrap", "connect",
+};
+
+/**
+ * Return the elapsed time between the start of a load and a phase in
+ * microseconds, or -1 if the phase has not been reached.
+ */
+int64_t
+twc_stats_load_elapsed(struct t_twc_stats const *stats,
+                       enum t_twc_stats_load_phase phase)
+{
+    if (!stats->load_time[TWC_STATS_LOAD_START] || !stats->load_time[phase])
+        return -1;
+
+    return stats->load_time[phase] - stats->load_time[TWC_STATS_LOAD_START];
+}
+
+/**
+ * Return the duration of a single load phase in microseconds, i.e. the time
+ * since the previous phase was reached, or -1 if it has not been reached.
+ */
+int64_t
+twc_stats_load_duration(struct t_twc_stats const *stats,
+                        enum t_twc_stats_load_phase phase)
+{
+    if (phase == TWC_STATS_LOAD_START || !stats->load_time[phase] ||
+        !stats->load_time[phase - 1])
+        return -1;
+
+    return stats->load_time[phase] - stats->load_time[phase - 1];
+}
+
+/**
+ * Add a counter to an infolist item. WeeChat infolists only have int
+ * variables, so the value is clamped.
+ */
+int
+twc_stats_infolist_add_counter(struct t_infolist_item *item, const char *name,
+                               uint64_t value)
+{
+    return weechat_infolist_new_var_integer(
+               item, name, value > INT_MAX ? INT_MAX : value) != NULL;
+}
+
+/**
+ * Add a timing to an infolist item, as <name>_count, <name>_max_usec,
+ * <name>_total_usec and <name>_histogram_<bucket> variables.
+ */
+int
+twc_stats_infolist_add_timing(struct t_infolist_item *item, const char *name,
+                              struct t_twc_stats_timing *timing)
+{
+    char var_name[128];
+
+    snprintf(var_name, sizeof(var_name), "%s_count", name);
+    if (!twc_stats_infolist_add_counter(item, var_name, timing->count))
+        return 0;
+    snprintf(var_name, sizeof(var_name), "%s_max_usec", name);
+    if (!twc_stats_infolist_add_counter(item, var_name, timing->max))
+        return 0;
+    snprintf(var_name, sizeof(var_name), "%s_total_usec", name);
+    if (!twc_stats_infolist_add_counter(item, var_name, timing->total))
+        return 0;
+
+    for (int i = 0; i < TWC_STATS_HISTOGRAM_BUCKETS; ++i)
+    {
+        snprintf(var_name, sizeof(var_name), "%s_histogram_%d", name, i);
+        if (!twc_stats_infolist_add_counter(item, var_name,
+                                            timing->histogram[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Add the statistics for a profile to an infolist.
+ */
+int
+twc_stats_infolist_add(struct t_infolist *infolist,
+                       struct t_twc_profile *profile)
+{
+    struct t_infolist_item *item = weechat_infolist_new_item(infolist);
+    if (!item)
+        return 0;
+
+    if (!weechat_infolist_new_var_string(item, "name", profile->name) ||
+        !weechat_infolist_new_var_integer(item, "loaded", profile->tox != NULL))
+        return 0;
+
+    for (int i = TWC_STATS_LOAD_READ; i < TWC_STATS_NUM_LOAD_PHASES; ++i)
+    {
+        char var_name[64];
+        snprintf(var_name, sizeof(var_name), "load_%s_usec",
+                 twc_stats_load_phase_names[i]);
+
+        /* WeeChat infolists only have int variables; clamp to be safe */
+        int64_t duration = twc_stats_load_duration(profile->stats, i);
+        if (duration > INT_MAX)
+            duration = INT_MAX;
+        if (!weechat_infolist_new_var_integer(item, var_name, duration))
+            return 0;
+    }
+
+    int64_t total =
+        twc_stats_load_elapsed(profile->stats, TWC_STATS_LOAD_CONNECT);
+    if (total > INT_MAX)
+        total = INT_MAX;
+    if (!weechat_infolist_new_var_integer(item, "load_total_usec", total))
+        return 0;
+
+    struct t_twc_stats_counters *counters = &profile->stats->counters;
+    if (!twc_stats_infolist_add_counter(item, "messages_in",
+                                        counters->messages_in) ||
+        !twc_stats_infolist_add_counter(item, "messages_out",
+                                        counters->messages_out) ||
+        !twc_stats_infolist_add_counter(item, "queue_depth",
+                                        profile->stats->queue_depth) ||
+        !twc_stats_infolist_add_counter(item, "queue_depth_peak",
+                                        profile->stats->queue_depth_peak) ||
+        !twc_stats_infolist_add_counter(item, "file_bytes_in",
+                                        counters->file_bytes_in) ||
+        !twc_stats_infolist_add_counter(item, "file_bytes_out",
+                                        counters->file_bytes_out) ||
+        !twc_stats_infolist_add_counter(item, "callbacks",
+                                        counters->callbacks) ||
+        !twc_stats_infolist_add_counter(item, "callbacks_per_second",
+                                        counters->callback_rate) ||
+        !twc_stats_infolist_add_counter(item, "timer_wakeups",
+                                        counters->iterate.count) ||
+        !twc_stats_infolist_add_timing(item, "iterate", &counters->iterate))
+        return 0;
+
+    for (int i = 1; i < TWC_TRACE_NUM_EVENTS; ++i)
+    {
+        if (!twc_stats_infolist_add_timing(item, twc_trace_event_names[i],
+                                           &counters->callback_timing[i]))
+            return 0;
+    }
+    for (int i = 1; i < TWC_STATS_SEND_ERRORS; ++i)
+    {
+        char var_name[64];
+        snprintf(var_name, sizeof(var_name), "friend_send_errors_%d", i);
+        if (!twc_stats_infolist_add_counter(item, var_name,
+                                            counters->friend_send_errors[i]))
+            return 0;
+
+        snprintf(var_name, sizeof(var_name), "group_send_errors_%d", i);
+        if (!twc_stats_infolist_add_counter(item, var_name,
+                                            counters->group_send_errors[i]))
+            return 0;
+    }
+
+    TOX_CONNECTION connection = profile->stats->load_connection;
+    if (!weechat_infolist_new_var_string(
+            item, "load_connection",
+            connection == TOX_CONNECTION_UDP
+                ? "udp"
+                : connection == TOX_CONNECTION_TCP ? "tcp" : "none"))
+        return 0;
+
+    return 1;
+}
+
+/**
+ * Callback for the "tox_stats" infolist. Returns statistics for the profile
+ * given as pointer or by name in arguments, or for all profiles.
+ */
+struct t_infolist *
+twc_stats_infolist_cb(const void *pointer, void *data,
+                      const char *infolist_name, void *obj_pointer,
+                      const char *arguments)
+{
+    struct t_infolist *infolist = weechat_infolist_new();
+    if (!infolist)
+        return NULL;
+
+    size_t index;
+    struct t_twc_list_item *item;
+    twc_list_foreach (twc_profiles, index, item)
+    {
+        if (obj_pointer && obj_pointer != item->profile)
+            continue;
+        if (arguments && arguments[0] &&
+            weechat_strcasecmp(arguments, item->profile->name) != 0)
+            continue;
+
+        if (!twc_stats_infolist_add(infolist, item->profile))
+        {
+            weechat_infolist_free(infolist);
+            return NULL;
+        }
+    }
+
+    return infolist;
+}
+
+/**
+ * Register the statistics infolist.
+ */
+void
+twc_stats_init()
+{
+    weechat_hook_infolist("tox_stats", "Tox profile statistics",
+                          "profile pointer (optional)",
+                          "profile name (optional)", twc_stats_infolist_cb,
+                          NULL, NULL);
+}
+
+/**
+ * Create a new, empty statistics object.
+ */
+struct t_twc_stats *
+twc_stats_new()
+{
+    struct t_twc_stats *stats = calloc(1, sizeof(struct t_twc_stats));
+    if (stats)
+        stats->load_connection = TOX_CONNECTION_NONE;
+
+    return stats;
+}
+
+/**
+ * Return the current monotonic time in microseconds.
+ */
+int64_t
+twc_stats_time()
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (int64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+}
+
+/**
+ * Reset load statistics and record the start of a profile load.
+ */
+void
+twc_stats_load_start(struct t_twc_stats *stats)
+{
+    memset(stats->load_time, 0, sizeof(stats->load_time));
+    memset(&stats->counters, 0, sizeof(stats->counters));
+    stats->load_connection = TOX_CONNECTION_NONE;
+    stats->load_time[TWC_STATS_LOAD_START] = twc_stats_time();
+}
+
+/**
+ * Record that a load phase has been completed.
+ */
+void
+twc_stats_load_mark(struct t_twc_stats *stats,
+                    enum t_twc_stats_load_phase phase)
+{
+    if (stats->load_time[TWC_STATS_LOAD_START])
+        stats->load_time[phase] = twc_stats_time();
+}
+
+/**
+ * Record the first connection to the Tox network since the profile was
+ * loaded. Later (re)connections are ignored.
+ */
+void
+twc_stats_load_connected(struct t_twc_stats *stats, TOX_CONNECTION connection)
+{
+    if (connection == TOX_CONNECTION_NONE ||
+        stats->load_time[TWC_STATS_LOAD_CONNECT])
+        return;
+
+    twc_stats_load_mark(stats, TWC_STATS_LOAD_CONNECT);
+    stats->load_connection = connection;
+}
+
+/**
+ * Add a duration, in microseconds, to a timing.
+ */
+void
+twc_stats_timing_add(struct t_twc_stats_timing *timing, int64_t duration)
+{
+    int bucket = 0;
+    while (bucket < TWC_STATS_HISTOGRAM_BUCKETS - 1 &&
+           duration >= (INT64_C(2) << bucket))
+        ++bucket;
+
+    ++timing->histogram[bucket];
+    ++timing->count;
+    timing->total += duration;
+    if (duration > timing->max)
+        timing->max = duration;
+}
+
+/**
+ * Return true if a duration, in microseconds, exceeds the profile's budget
+ * for callbacks and iterations.
+ */
+bool
+twc_stats_over_budget(struct t_twc_profile *profile, int64_t duration)
+{
+    int budget = profile->values.callback_budget;
+    return budget > 0 && duration > (int64_t)budget * 1000;
+}
+
+/**
+ * Record a wakeup of the Tox iteration timer and how long tox_iterate took,
+ * in microseconds. Reports the iteration if it was over budget.
+ */
+void
+twc_stats_timer_wakeup(struct t_twc_profile *profile, int64_t iterate_duration)
+{
+    struct t_twc_stats_counters *counters = &profile->stats->counters;
+
+    twc_stats_timing_add(&counters->iterate, iterate_duration);
+    if (twc_stats_over_budget(profile, iterate_duration))
+    {
+        weechat_printf(profile->buffer,
+                       "%sslow tox_iterate: %" PRId64 ".%03" PRId64 " ms",
+                       weechat_prefix("network"), iterate_duration / 1000,
+                       iterate_duration % 1000);
+    }
+
+    int64_t now = twc_stats_time();
+    int64_t window = now - counters->callback_window_start;
+    if (window >= 1000000)
+    {
+        if (counters->callback_window_start)
+        {
+            counters->callback_rate =
+                (counters->callbacks - counters->callback_window_base) *
+                1000000 / window;
+        }
+        counters->callback_window_start = now;
+        counters->callback_window_base = counters->callbacks;
+    }
+}
+
+/**
+ * Count a Tox callback and remember its arguments until it is done.
+ */
+void
+twc_stats_callback_start(struct t_twc_stats *stats,
+                         enum t_twc_trace_event event, uint32_t a, uint32_t b,
+                         uint32_t c, uint64_t d, size_t length)
+{
+    ++stats->counters.callbacks;
+    stats->current_callback = (struct t_twc_stats_callback_args){
+        event, a, b, c, d, length,
+    };
+}
+
+/**
+ * Record how long the current Tox callback took, given its start time in
+ * microseconds. Reports the callback and its arguments if it was over
+ * budget.
+ */
+void
+twc_stats_callback_done(struct t_twc_profile *profile, int64_t start)
+{
+    int64_t duration = twc_stats_time() - start;
+    struct t_twc_stats_callback_args *args = &profile->stats->current_callback;
+    if (args->event <= 0 || args->event >= TWC_TRACE_NUM_EVENTS)
+        return;
+
+    twc_stats_timing_add(&profile->stats->counters.callback_timing[args->event],
+                         duration);
+    if (twc_stats_over_budget(profile, duration))
+    {
+        weechat_printf(profile->buffer,
+                       "%sslow callback %s: %" PRId64 ".%03" PRId64
+                       " ms (arguments %" PRIu32 ", %" PRIu32 ", %" PRIu32
+                       ", %" PRIu64 ", %zu bytes)",
+                       weechat_prefix("network"),
+                       twc_trace_event_names[args->event], duration / 1000,
+                       duration % 1000, args->a, args->b, args->c, args->d,
+                       args->length);
+    }
+    args->event = 0;
+}
+
+/**
+ * Count a failed message send by its Tox error code.
+ */
+void
+twc_stats_send_error(struct t_twc_stats *stats, bool group, int error)
+{
+    if (error < 0 || error >= TWC_STATS_SEND_ERRORS)
+        error = TWC_STATS_SEND_ERRORS - 1;
+
+    if (group)
+        ++stats->counters.group_send_errors[error];
+    else
+        ++stats->counters.friend_send_errors[error];
+}
+
+/**
+ * Count a message added to a friend message queue.
+ */
+void
+twc_stats_queue_add(struct t_twc_stats *stats)
+{
+    ++stats->queue_depth;
+    if (stats->queue_depth > stats->queue_depth_peak)
+        stats->queue_depth_peak = stats->queue_depth;
+}
+
+/**
+ * Print a timing, with the non-empty histogram buckets, to a buffer.
+ */
+void
+twc_stats_print_timing(struct t_gui_buffer *buffer, const char *name,
+                       struct t_twc_stats_timing *timing)
+{
+    if (!timing->count)
+        return;
+
+    char histogram[TWC_STATS_HISTOGRAM_BUCKETS * 48] = "";
+    size_t length = 0;
+    for (int i = 0; i < TWC_STATS_HISTOGRAM_BUCKETS; ++i)
+    {
+        if (!timing->histogram[i])
+            continue;
+
+        if (i < TWC_STATS_HISTOGRAM_BUCKETS - 1)
+        {
+            length += snprintf(histogram + length, sizeof(histogram) - length,
+                               "%s<%" PRId64 ": %" PRIu64, length ? ", " : "",
+                               INT64_C(2) << i, timing->histogram[i]);
+        }
+        else
+        {
+            length += snprintf(histogram + length, sizeof(histogram) - length,
+                               "%slonger: %" PRIu64, length ? ", " : "",
+                               timing->histogram[i]);
+        }
+    }
+
+    weechat_printf(buffer,
+                   "%s  %s: %" PRIu64 " calls, %" PRId64 " us average, %" PRId64
+                   " us max (us: %s)",
+                   weechat_prefix("network"), name, timing->count,
+                   timing->total / (int64_t)timing->count, timing->max,
+                   histogram);
+}
+
+/**
+ * Print activity counters for a profile to a buffer.
+ */
+void
+twc_stats_print_counters(struct t_twc_stats *stats,
+                         struct t_gui_buffer *buffer)
+{
+    struct t_twc_stats_counters *counters = &stats->counters;
+    const char *prefix = weechat_prefix("network");
+
+    weechat_printf(buffer,
+                   "%s  messages: %" PRIu64 " in, %" PRIu64 " out, %" PRIu64
+                   " queued (peak %" PRIu64 ")",
+                   prefix, counters->messages_in, counters->messages_out,
+                   stats->queue_depth, stats->queue_depth_peak);
+
+    for (int i = 1; i < TWC_STATS_SEND_ERRORS; ++i)
+    {
+        if (counters->friend_send_errors[i])
+        {
+            weechat_printf(buffer,
+                           "%s  friend send error %d: %" PRIu64, prefix, i,
+                           counters->friend_send_errors[i]);
+        }
+        if (counters->group_send_errors[i])
+        {
+            weechat_printf(buffer,
+                           "%s  group send error %d: %" PRIu64, prefix, i,
+                           counters->group_send_errors[i]);
+        }
+    }
+
+    weechat_printf(buffer,
+                   "%s  file transfers: %" PRIu64 " bytes in, %" PRIu64
+                   " bytes out",
+                   prefix, counters->file_bytes_in, counters->file_bytes_out);
+    weechat_printf(buffer,
+                   "%s  callbacks: %" PRIu64 " (%" PRIu64 "/s), timer "
+                   "wakeups: %" PRIu64,
+                   prefix, counters->callbacks, counters->callback_rate,
+                   counters->iterate.count);
+
+    twc_stats_print_timing(buffer, "tox_iterate", &counters->iterate);
+    for (int i = 1; i < TWC_TRACE_NUM_EVENTS; ++i)
+    {
+        twc_stats_print_timing(buffer, twc_trace_event_names[i],
+                               &counters->callback_timing[i]);
+    }
+}
+
+/**
+ * Print statistics for a profile to a buffer.
+ */
+void
+twc_stats_print(struct t_twc_profile *profile, struct t_gui_buffer *buffer)
+{
+    struct t_twc_stats *stats = profile->stats;
+
+    weechat_printf(buffer, "%sStatistics for profile %s:",
+                   weechat_prefix("network"), profile->name);
+
+    if (!stats->load_time[TWC_STATS_LOAD_START])
+    {
+        weechat_printf(buffer, "%s  profile has not been loaded",
+                       weechat_prefix("network"));
+        return;
+    }
+
+    for (int i = TWC_STATS_LOAD_READ; i < TWC_STATS_NUM_LOAD_PHASES; ++i)
+    {
+        int64_t duration = twc_stats_load_duration(stats, i);
+        if (duration < 0)
+        {
+            weechat_printf(buffer, "%s  %-10s not reached",
+                           weechat_prefix("network"),
+                           twc_stats_load_phase_names[i]);
+            continue;
+        }
+
+        weechat_printf(buffer, "%s  %-10s %" PRId64 ".%03" PRId64 " ms",
+                       weechat_prefix("network"),
+                       twc_stats_load_phase_names[i], duration / 1000,
+                       duration % 1000);
+    }
+
+    int64_t total = twc_stats_load_elapsed(stats, TWC_STATS_LOAD_CONNECT);
+    if (total >= 0)
+    {
+        weechat_printf(buffer,
+                       "%s  time to first connection: %" PRId64 ".%03" PRId64
+                       " ms (%s)",
+                       weechat_prefix("network"), total / 1000, total % 1000,
+                       stats->load_connection == TOX_CONNECTION_UDP ? "UDP"
+                                                                    : "TCP");
+    }
+
+    twc_stats_print_counters(stats, buffer);
+}
+
+/**
+ * Free a statistics object.
+ */
+void
+twc_stats_free(struct t_twc_stats *stats)
+{
+    free(stats);
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_STATS_H
+#define TOX_WEECHAT_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <tox/tox.h>
+
+#include "twc-trace.h"
+
+struct t_twc_profile;
+struct t_gui_buffer;
+
+/**
+ * Phases of loading a profile, in the order they are reached.
+ */
+enum t_twc_stats_load_phase
+{
+    TWC_STATS_LOAD_START = 0,
+    TWC_STATS_LOAD_READ,
+    TWC_STATS_LOAD_DECRYPT,
+    TWC_STATS_LOAD_TOX_NEW,
+    TWC_STATS_LOAD_BOOTSTRAP,
+    TWC_STATS_LOAD_CONNECT,
+
+    TWC_STATS_NUM_LOAD_PHASES,
+};
+
+#define TWC_STATS_HISTOGRAM_BUCKETS 16
+#define TWC_STATS_SEND_ERRORS 8
+
+/**
+ * Durations of a timed operation, in microseconds. Histogram bucket i counts
+ * durations below 2^(i + 1) microseconds, the last one everything longer.
+ */
+struct t_twc_stats_timing
+{
+    uint64_t count;
+    int64_t total;
+    int64_t max;
+    uint64_t histogram[TWC_STATS_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * The Tox callback being run and its arguments, as passed to
+ * twc_trace_record, for reporting slow callbacks.
+ */
+struct t_twc_stats_callback_args
+{
+    enum t_twc_trace_event event;
+    uint32_t a, b, c;
+    uint64_t d;
+    size_t length;
+};
+
+/**
+ * Activity counters of a profile, reset when it is loaded. Updated directly
+ * from the hot paths, so they are plain fields.
+ */
+struct t_twc_stats_counters
+{
+    uint64_t messages_in;
+    uint64_t messages_out;
+    /* failed sends, indexed by TOX_ERR_FRIEND_SEND_MESSAGE and
+     * TOX_ERR_CONFERENCE_SEND_MESSAGE codes */
+    uint64_t friend_send_errors[TWC_STATS_SEND_ERRORS];
+    uint64_t group_send_errors[TWC_STATS_SEND_ERRORS];
+    uint64_t file_bytes_in;
+    uint64_t file_bytes_out;
+    uint64_t callbacks;
+
+    /* callbacks per second, measured over windows of at least a second */
+    int64_t callback_window_start;
+    uint64_t callback_window_base;
+    uint64_t callback_rate;
+
+    /* tox_iterate, timed once per timer wakeup, and each kind of callback */
+    struct t_twc_stats_timing iterate;
+    struct t_twc_stats_timing callback_timing[TWC_TRACE_NUM_EVENTS];
+};
+
+struct t_twc_stats
+{
+    /* monotonic timestamps (in microseconds) for each load phase, 0 if the
+     * phase has not been reached since the last load */
+    int64_t load_time[TWC_STATS_NUM_LOAD_PHASES];
+    TOX_CONNECTION load_connection;
+
+    struct t_twc_stats_counters counters;
+
+    /* messages waiting in friend message queues, which outlive loads */
+    uint64_t queue_depth;
+    uint64_t queue_depth_peak;
+
+    struct t_twc_stats_callback_args current_callback;
+};
+
+void
+twc_stats_init();
+
+struct t_twc_stats *
+twc_stats_new();
+
+int64_t
+twc_stats_time();
+
+void
+twc_stats_load_start(struct t_twc_stats *stats);
+
+void
+twc_stats_load_mark(struct t_twc_stats *stats,
+                    enum t_twc_stats_load_phase phase);
+
+void
+twc_stats_load_connected(struct t_twc_stats *stats, TOX_CONNECTION connection);
+
+void
+twc_stats_timer_wakeup(struct t_twc_profile *profile, int64_t iterate_duration);
+
+void
+twc_stats_callback_start(struct t_twc_stats *stats,
+                         enum t_twc_trace_event event, uint32_t a, uint32_t b,
+                         uint32_t c, uint64_t d, size_t length);
+
+void
+twc_stats_callback_done(struct t_twc_profile *profile, int64_t start);
+
+void
+twc_stats_send_error(struct t_twc_stats *stats, bool group, int error);
+
+void
+twc_stats_queue_add(struct t_twc_stats *stats);
+
+void
+twc_stats_print_counters(struct t_twc_stats *stats,
+                         struct t_gui_buffer *buffer);
+
+void
+twc_stats_print(struct t_twc_profile *profile, struct t_gui_buffer *buffer);
+
+void
+twc_stats_free(struct t_twc_stats *stats);
+
+#endif /* TOX_WEECHAT_STATS_H */
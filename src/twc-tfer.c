@@ -24,6 +24,7 @@
 #include <weechat/weechat-plugin.h>
 
 #include "twc-list.h"
+#include "twc-memory.h"
 #include "twc-profile.h"
 #include "twc-tfer.h"
 #include "twc-utils.h"
@@ -256,14 +257,16 @@ twc_tfer_file_new(struct t_twc_profile *profile, const char *nickname,
                   uint32_t file_number, uint64_t size,
                   enum t_twc_tfer_file_type filetype)
 {
-    struct t_twc_tfer_file *file = malloc(sizeof(struct t_twc_tfer_file));
+    struct t_twc_tfer_file *file = twc_memory_alloc(
+        profile->memory, TWC_MEMORY_TFER, sizeof(struct t_twc_tfer_file));
     file->status = TWC_TFER_FILE_STATUS_REQUEST;
     file->type = filetype;
     file->position = 0;
     file->timestamp = 0;
     file->cached_speed = 0;
     file->after_last_cache = 0;
-    file->nickname = strdup(nickname);
+    file->nickname =
+        twc_memory_strdup(profile->memory, TWC_MEMORY_TFER, nickname);
     file->friend_number = friend_number;
     file->file_number = file_number;
     file->size = size;
@@ -274,7 +277,12 @@ twc_tfer_file_new(struct t_twc_profile *profile, const char *nickname,
         char *final_name = twc_tfer_file_name_strip(
             filename, FILENAME_MAX + 1 - strlen(full_path));
         if (!final_name)
+        {
+            free(full_path);
+            twc_memory_free(file->nickname);
+            twc_memory_free(file);
             return NULL;
+        }
 
         char *slash = strrchr(full_path, '/');
         if (*(slash + sizeof(char)) != '\0')
@@ -496,14 +504,20 @@ twc_tfer_file_update(struct t_twc_tfer *tfer, struct t_twc_tfer_file *file)
 
 /**
  * Allocate and return "uint8_t data[length]" chunk of data starting from
- * "position".
+ * "position", accounted to the profile's file transfers. Must be freed with
+ * twc_memory_free.
  */
 uint8_t *
-twc_tfer_file_get_chunk(struct t_twc_tfer_file *file, uint64_t position,
+twc_tfer_file_get_chunk(struct t_twc_profile *profile,
+                        struct t_twc_tfer_file *file, uint64_t position,
                         size_t length)
 {
     fseek(file->fp, position, SEEK_SET);
-    uint8_t *data = malloc(sizeof(uint8_t) * length);
+    uint8_t *data = twc_memory_alloc(profile->memory, TWC_MEMORY_TFER,
+                                     sizeof(uint8_t) * length);
+    if (!data)
+        return NULL;
+
     size_t read = fread(data, sizeof(uint8_t), length, file->fp);
     while ((read < length) && !feof(file->fp))
     {
@@ -511,7 +525,10 @@ twc_tfer_file_get_chunk(struct t_twc_tfer_file *file, uint64_t position,
                       length - read, file->fp);
     }
     if (read != length)
+    {
+        twc_memory_free(data);
         return NULL;
+    }
     return data;
 }
 
@@ -820,10 +837,10 @@ void
 twc_tfer_file_free(struct t_twc_tfer_file *file)
 {
     free(file->filename);
-    free(file->nickname);
+    twc_memory_free(file->nickname);
     if (file->full_path)
         free(file->full_path);
-    free(file);
+    twc_memory_free(file);
 }
 
 void
@@ -834,7 +851,7 @@ twc_tfer_free(struct t_twc_tfer *tfer)
     {
         twc_tfer_file_free(file);
     }
-    free(tfer->files);
+    twc_list_free(tfer->files);
     free(tfer->downloading_path);
     free(tfer);
 }
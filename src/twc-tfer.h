@@ -112,7 +112,8 @@ void
 twc_tfer_file_add(struct t_twc_tfer *tfer, struct t_twc_tfer_file *file);
 
 uint8_t *
-twc_tfer_file_get_chunk(struct t_twc_tfer_file *file, uint64_t position,
+twc_tfer_file_get_chunk(struct t_twc_profile *profile,
+                        struct t_twc_tfer_file *file, uint64_t position,
                         size_t length);
 
 bool
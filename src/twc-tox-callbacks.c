@@ -27,17 +27,52 @@
 #include <tox/toxav.h>
 #endif /* TOXAV_ENABLED */
 
+#include "twc-bootstrap.h"
 #include "twc-chat.h"
+#include "twc-flood.h"
+#include "twc-friend-cache.h"
 #include "twc-friend-request.h"
 #include "twc-group-invite.h"
+#include "twc-group-peer.h"
+#include "twc-memory.h"
 #include "twc-message-queue.h"
 #include "twc-profile.h"
+#include "twc-scratch.h"
+#include "twc-span.h"
+#include "twc-stats.h"
 #include "twc-tfer.h"
+#include "twc-trace.h"
 #include "twc-utils.h"
 #include "twc.h"
 
 #include "twc-tox-callbacks.h"
 
+/* number of friend connection changes in one Tox iteration above which they
+ * are summarized in the profile buffer */
+#define TWC_CONNECTION_SUMMARY_THRESHOLD (3)
+
+/* count a callback in the profile statistics, and record it if the profile
+ * is being traced */
+#define TWC_CALLBACK(profile, event, a, b, c, d, data, length)                 \
+    do                                                                         \
+    {                                                                          \
+        twc_stats_callback_start((profile)->stats, event, a, b, c, d, length); \
+        if ((profile)->trace_file)                                             \
+            twc_trace_record(profile, event, a, b, c, d, data, length);        \
+    } while (0)
+
+/* define a wrapper around a Tox callback that times it for the slow callback
+ * watchdog and span recording; the last parameter must be the profile, named
+ * data */
+#define TWC_TIMED_CALLBACK(callback, params, args)                             \
+    void callback##_timed params                                               \
+    {                                                                          \
+        int64_t start = twc_stats_time();                                      \
+        callback args;                                                         \
+        twc_stats_callback_done(data, start);                                  \
+        TWC_SPAN_END(start, "callback", #callback, data);                      \
+    }
+
 #define TWC_TFER_FILE_UPDATE_STATUS(st)                                        \
     do                                                                         \
     {                                                                          \
@@ -57,7 +92,12 @@ twc_do_timer_cb(const void *pointer, void *data, int remaining_calls)
     struct t_twc_profile *profile = (void *)pointer;
 
     interval = tox_iteration_interval(profile->tox);
+    int64_t iterate_start = twc_stats_time();
     tox_iterate(profile->tox, profile);
+    twc_stats_timer_wakeup(profile, twc_stats_time() - iterate_start);
+    TWC_SPAN_END(iterate_start, "tox", "tox_iterate", profile);
+    twc_connection_status_flush(profile);
+    twc_scratch_reset();
     struct t_hook *hook =
         weechat_hook_timer(interval, 0, 1, twc_do_timer_cb, profile, NULL);
     profile->tox_do_timer = hook;
@@ -67,8 +107,10 @@ twc_do_timer_cb(const void *pointer, void *data, int remaining_calls)
     bool is_connected =
         connection == TOX_CONNECTION_TCP || connection == TOX_CONNECTION_UDP;
     twc_profile_set_online_status(profile, is_connected);
+    twc_stats_load_connected(profile->stats, connection);
+    twc_bootstrap_check(profile, connection);
 
-    if (TWC_PROFILE_OPTION_BOOLEAN(profile, TWC_PROFILE_OPTION_AUTOJOIN))
+    if (profile->values.autojoin)
     {
         struct t_twc_group_chat_invite *invite;
         for (i = 0; (invite = twc_group_chat_invite_with_index(profile, i));
@@ -77,8 +119,8 @@ twc_do_timer_cb(const void *pointer, void *data, int remaining_calls)
             {
                 struct t_twc_chat *friend_chat = twc_chat_search_friend(
                     profile, invite->friend_number, false);
-                char *friend_name =
-                    twc_get_name_nt(profile->tox, invite->friend_number);
+                const char *friend_name = twc_friend_cache_name(
+                    profile, invite->friend_number);
                 char *type_str;
                 switch (invite->group_chat_type)
                 {
@@ -152,18 +194,18 @@ twc_friend_message_callback(Tox *tox, uint32_t friend_number,
                             size_t length, void *data)
 {
     struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_FRIEND_MESSAGE, friend_number, type, 0, 0,
+                 message, length);
+    ++profile->stats->counters.messages_in;
     struct t_twc_chat *chat =
         twc_chat_search_friend(profile, friend_number, true);
 
-    char *name = twc_get_name_nt(profile->tox, friend_number);
-    char *message_nt = twc_null_terminate(message, length);
+    const char *name = twc_friend_cache_name(profile, friend_number);
+    char *message_nt = twc_scratch_null_terminate(message, length);
 
     twc_chat_print_message(chat, "notify_private",
                            weechat_color("chat_nick_other"), name, message_nt,
                            type);
-
-    free(name);
-    free(message_nt);
 }
 
 void
@@ -171,34 +213,70 @@ twc_connection_status_callback(Tox *tox, uint32_t friend_number,
                                TOX_CONNECTION status, void *data)
 {
     struct t_twc_profile *profile = data;
-    char *name = twc_get_name_nt(profile->tox, friend_number);
-    struct t_gui_nick *nick = NULL;
+    TWC_CALLBACK(profile, TWC_TRACE_CONNECTION_STATUS, friend_number, status, 0,
+                 0, NULL, 0);
+    int32_t friend = friend_number;
+    int connection = status;
+
+    /* applied after tox_iterate by twc_connection_status_flush, keeping only
+     * the latest status of each friend */
+    weechat_hashtable_set(profile->connection_changes, &friend, &connection);
+}
+
+struct t_twc_connection_flush_data
+{
+    struct t_twc_profile *profile;
+    int online;
+    int offline;
+    bool summarize;
+};
+
+/**
+ * Hashtable map callback applying a friend's connection change to the
+ * nicklist and chat buffer, and to the profile buffer unless summarized.
+ */
+void
+twc_connection_status_flush_map_callback(void *data,
+                                         struct t_hashtable *hashtable,
+                                         const void *key, const void *value)
+{
+    struct t_twc_connection_flush_data *flush = data;
+    struct t_twc_profile *profile = flush->profile;
+    int32_t friend_number = *(int32_t *)key;
+    TOX_CONNECTION status = *(int *)value;
+
+    const char *name = twc_friend_cache_name(profile, friend_number);
     struct t_twc_chat *chat =
         twc_chat_search_friend(profile, friend_number, false);
 
-    /* TODO: print in friend's buffer if it exists */
     if (status == TOX_CONNECTION_NONE)
     {
-        nick = weechat_nicklist_search_nick(profile->buffer,
-                                            profile->nicklist_group, name);
+        struct t_gui_nick *nick = weechat_nicklist_search_nick(
+            profile->buffer, profile->nicklist_group, name);
         if (nick)
             weechat_nicklist_remove_nick(profile->buffer, nick);
 
-        weechat_printf(profile->buffer, "%s%s just went offline.",
-                       weechat_prefix("network"), name);
+        if (!flush->summarize)
+        {
+            weechat_printf(profile->buffer, "%s%s just went offline.",
+                           weechat_prefix("network"), name);
+        }
         if (chat)
         {
             weechat_printf(chat->buffer, "%s%s just went offline.",
                            weechat_prefix("network"), name);
         }
     }
-    else if ((status == TOX_CONNECTION_TCP) || (status == TOX_CONNECTION_UDP))
+    else
     {
         weechat_nicklist_add_nick(profile->buffer, profile->nicklist_group,
                                   name, NULL, NULL, NULL, 1);
 
-        weechat_printf(profile->buffer, "%s%s just came online.",
-                       weechat_prefix("network"), name);
+        if (!flush->summarize)
+        {
+            weechat_printf(profile->buffer, "%s%s just came online.",
+                           weechat_prefix("network"), name);
+        }
         if (chat)
         {
             weechat_printf(chat->buffer, "%s%s just came online.",
@@ -206,7 +284,58 @@ twc_connection_status_callback(Tox *tox, uint32_t friend_number,
         }
         twc_message_queue_flush_friend(profile, friend_number);
     }
-    free(name);
+}
+
+/**
+ * Hashtable map callback counting friends that came online or went offline.
+ */
+void
+twc_connection_status_count_map_callback(void *data,
+                                         struct t_hashtable *hashtable,
+                                         const void *key, const void *value)
+{
+    struct t_twc_connection_flush_data *flush = data;
+
+    if (*(int *)value == TOX_CONNECTION_NONE)
+        ++(flush->offline);
+    else
+        ++(flush->online);
+}
+
+/**
+ * Apply the friend connection changes collected during a Tox iteration. If
+ * many friends changed at once (e.g. when the profile connects), the profile
+ * buffer gets one summary line instead of a line per friend.
+ */
+void
+twc_connection_status_flush(struct t_twc_profile *profile)
+{
+    if (!weechat_hashtable_get_integer(profile->connection_changes,
+                                       "items_count"))
+        return;
+
+    struct t_twc_connection_flush_data flush = {profile, 0, 0, false};
+    weechat_hashtable_map(profile->connection_changes,
+                          twc_connection_status_count_map_callback, &flush);
+    flush.summarize =
+        flush.online + flush.offline > TWC_CONNECTION_SUMMARY_THRESHOLD;
+
+    weechat_hashtable_map(profile->connection_changes,
+                          twc_connection_status_flush_map_callback, &flush);
+    weechat_hashtable_remove_all(profile->connection_changes);
+
+    if (flush.summarize && flush.online)
+    {
+        weechat_printf(profile->buffer, "%s%d friend%s came online.",
+                       weechat_prefix("network"), flush.online,
+                       flush.online == 1 ? "" : "s");
+    }
+    if (flush.summarize && flush.offline)
+    {
+        weechat_printf(profile->buffer, "%s%d friend%s went offline.",
+                       weechat_prefix("network"), flush.offline,
+                       flush.offline == 1 ? "" : "s");
+    }
 }
 
 void
@@ -214,12 +343,18 @@ twc_name_change_callback(Tox *tox, uint32_t friend_number, const uint8_t *name,
                          size_t length, void *data)
 {
     struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_NAME, friend_number, 0, 0, 0, name, length);
     struct t_gui_nick *nick = NULL;
     struct t_twc_chat *chat =
         twc_chat_search_friend(profile, friend_number, false);
 
-    char *old_name = twc_get_name_nt(profile->tox, friend_number);
-    char *new_name = twc_null_terminate(name, length);
+    /* toxcore calls this before changing the name, so the cache still has
+     * the old one */
+    const char *cached_name = twc_friend_cache_name(profile, friend_number);
+    char *old_name = twc_scratch_null_terminate((const uint8_t *)cached_name,
+                                                strlen(cached_name));
+    char *new_name = twc_scratch_null_terminate(name, length);
+    twc_friend_cache_set_name(profile, friend_number, new_name);
 
     if (strcmp(old_name, new_name) != 0)
     {
@@ -251,16 +386,14 @@ twc_name_change_callback(Tox *tox, uint32_t friend_number, const uint8_t *name,
                 file = item->file;
                 if (file->friend_number == friend_number)
                 {
-                    free(file->nickname);
-                    file->nickname = strdup(new_name);
+                    twc_memory_free(file->nickname);
+                    file->nickname = twc_memory_strdup(
+                        profile->memory, TWC_MEMORY_TFER, new_name);
                     twc_tfer_file_update(profile->tfer, item->file);
                 }
             }
         }
     }
-
-    free(old_name);
-    free(new_name);
 }
 
 void
@@ -268,6 +401,8 @@ twc_user_status_callback(Tox *tox, uint32_t friend_number,
                          TOX_USER_STATUS status, void *data)
 {
     struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_USER_STATUS, friend_number, status, 0, 0,
+                 NULL, 0);
     struct t_twc_chat *chat =
         twc_chat_search_friend(profile, friend_number, false);
     if (chat)
@@ -279,8 +414,14 @@ twc_status_message_callback(Tox *tox, uint32_t friend_number,
                             const uint8_t *message, size_t length, void *data)
 {
     struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_STATUS_MESSAGE, friend_number, 0, 0, 0,
+                 message, length);
     struct t_twc_chat *chat =
         twc_chat_search_friend(profile, friend_number, false);
+
+    char *message_nt = twc_scratch_null_terminate(message, length);
+    twc_friend_cache_set_status_message(profile, friend_number, message_nt);
+
     if (chat)
         twc_chat_queue_refresh(chat);
 }
@@ -290,8 +431,22 @@ twc_friend_request_callback(Tox *tox, const uint8_t *public_key,
                             const uint8_t *message, size_t length, void *data)
 {
     struct t_twc_profile *profile = data;
+    twc_stats_callback_start(profile->stats, TWC_TRACE_FRIEND_REQUEST, 0, 0, 0,
+                             0, length);
+    if (profile->trace_file)
+    {
+        /* the public key is stored in front of the message */
+        uint8_t *request = twc_scratch_alloc(TOX_PUBLIC_KEY_SIZE + length);
+        if (request)
+        {
+            memcpy(request, public_key, TOX_PUBLIC_KEY_SIZE);
+            memcpy(request + TOX_PUBLIC_KEY_SIZE, message, length);
+            twc_trace_record(profile, TWC_TRACE_FRIEND_REQUEST, 0, 0, 0, 0,
+                             request, TOX_PUBLIC_KEY_SIZE + length);
+        }
+    }
 
-    char *message_nt = twc_null_terminate(message, length);
+    char *message_nt = twc_scratch_null_terminate(message, length);
     int rc = twc_friend_request_add(profile, public_key, message_nt);
 
     if (rc == -1)
@@ -321,8 +476,6 @@ twc_friend_request_callback(Tox *tox, const uint8_t *public_key,
                 weechat_prefix("error"));
         }
     }
-
-    free(message_nt);
 }
 
 void
@@ -332,7 +485,9 @@ twc_group_invite_callback(Tox *tox, uint32_t friend_number,
 {
     TOX_ERR_CONFERENCE_JOIN err = TOX_ERR_CONFERENCE_JOIN_OK;
     struct t_twc_profile *profile = data;
-    char *friend_name = twc_get_name_nt(profile->tox, friend_number);
+    TWC_CALLBACK(profile, TWC_TRACE_GROUP_INVITE, friend_number, type, 0, 0,
+                 invite_data, length);
+    const char *friend_name = twc_friend_cache_name(profile, friend_number);
     struct t_twc_chat *friend_chat =
         twc_chat_search_friend(profile, friend_number, false);
     int rc;
@@ -395,7 +550,6 @@ twc_group_invite_callback(Tox *tox, uint32_t friend_number,
             weechat_prefix("network"), weechat_color("chat_nick_other"),
             friend_name, weechat_color("reset"), rc);
     }
-    free(friend_name);
 }
 
 void
@@ -403,34 +557,31 @@ twc_handle_group_message(Tox *tox, int32_t group_number, int32_t peer_number,
                          const uint8_t *message, uint16_t length, void *data,
                          TOX_MESSAGE_TYPE message_type)
 {
-    TOX_ERR_CONFERENCE_PEER_QUERY err = TOX_ERR_CONFERENCE_PEER_QUERY_OK;
-    bool rc;
     struct t_twc_profile *profile = data;
 
     struct t_twc_chat *chat =
         twc_chat_search_group(profile, group_number, true);
 
-    char *myname = twc_get_self_name_nt(profile->tox);
-    char *name = twc_get_peer_name_nt(profile->tox, group_number, peer_number);
-    char *tags = "notify_message";
-    char *message_nt = twc_null_terminate(message, length);
+    /* messages can arrive before the peer list has been updated */
+    struct t_twc_group_peer *peer = twc_group_peer_get(chat, peer_number);
+    if (!peer)
+    {
+        twc_group_peer_update_list(chat);
+        peer = twc_group_peer_get(chat, peer_number);
+    }
 
-    const char *nick_color;
-    rc = tox_conference_peer_number_is_ours(tox, group_number, peer_number,
-                                            &err);
-    if (rc && (err == TOX_ERR_CONFERENCE_PEER_QUERY_OK))
-        nick_color = weechat_color("chat_nick_self");
-    else
-        nick_color = weechat_info_get("nick_color", name);
+    char *message_nt = twc_scratch_null_terminate(message, length);
+    bool highlight = twc_profile_has_highlight(profile, message_nt);
 
-    if (weechat_string_has_highlight(message_nt, myname))
-        tags = "notify_highlight";
+    /* messages that highlight us are never suppressed */
+    if (!highlight && !twc_flood_check_group_message(chat, peer))
+        return;
+
+    const char *name = peer ? peer->name : "<unknown>";
+    const char *nick_color = peer ? twc_group_peer_color(chat, peer) : "";
+    char *tags = highlight ? "notify_highlight" : "notify_message";
     twc_chat_print_message(chat, tags, nick_color, name, message_nt,
                            message_type);
-
-    free(name);
-    free(myname);
-    free(message_nt);
 }
 
 void
@@ -438,6 +589,11 @@ twc_group_message_callback(Tox *tox, uint32_t group_number,
                            uint32_t peer_number, TOX_MESSAGE_TYPE type,
                            const uint8_t *message, size_t length, void *data)
 {
+    struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_GROUP_MESSAGE, group_number, peer_number,
+                 type, 0, message, length);
+    ++profile->stats->counters.messages_in;
+
     twc_handle_group_message(tox, group_number, peer_number, message, length,
                              data, type);
 }
@@ -447,67 +603,12 @@ twc_group_peer_list_changed_callback(Tox *tox, uint32_t group_number,
                                      void *data)
 {
     struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_GROUP_PEER_LIST_CHANGED, group_number, 0, 0,
+                 0, NULL, 0);
     struct t_twc_chat *chat =
         twc_chat_search_group(profile, group_number, true);
 
-    struct t_gui_nick *nick = NULL;
-    int i, npeers;
-    TOX_ERR_CONFERENCE_PEER_QUERY err = TOX_ERR_CONFERENCE_PEER_QUERY_OK;
-
-    struct t_weelist *new_nicks;
-    struct t_weelist_item *n;
-
-    npeers = tox_conference_peer_count(profile->tox, group_number, &err);
-
-    if (err == TOX_ERR_CONFERENCE_PEER_QUERY_OK)
-    {
-        new_nicks = weechat_list_new();
-        for (i = 0; i < npeers; i++)
-        {
-            char *name = twc_get_peer_name_nt(profile->tox, group_number, i);
-            weechat_list_add(new_nicks, name, WEECHAT_LIST_POS_END, NULL);
-            free(name);
-        }
-    }
-    else
-        return;
-
-    /* searching for exits */
-    n = weechat_list_get(chat->nicks, 0);
-
-    while (n)
-    {
-        const char *name = weechat_list_string(n);
-        if (!weechat_list_search(new_nicks, name))
-        {
-            weechat_printf(chat->buffer, "%s%s just left the group chat",
-                           weechat_prefix("quit"), name);
-            nick = weechat_nicklist_search_nick(chat->buffer,
-                                                chat->nicklist_group, name);
-            weechat_nicklist_remove_nick(chat->buffer, nick);
-        }
-        n = weechat_list_next(n);
-    }
-
-    /* searching for joins */
-    n = weechat_list_get(new_nicks, 0);
-
-    while (n)
-    {
-        const char *name = weechat_list_string(n);
-        if (!weechat_list_search(chat->nicks, name))
-        {
-            weechat_printf(chat->buffer, "%s%s just joined the group chat",
-                           weechat_prefix("join"), name);
-            weechat_nicklist_add_nick(chat->buffer, chat->nicklist_group, name,
-                                      NULL, NULL, NULL, 1);
-        }
-        n = weechat_list_next(n);
-    }
-
-    weechat_list_remove_all(chat->nicks);
-    weechat_list_free(chat->nicks);
-    chat->nicks = new_nicks;
+    twc_group_peer_update_list(chat);
 }
 
 void
@@ -516,62 +617,13 @@ twc_group_peer_name_callback(Tox *tox, uint32_t group_number,
                              size_t pname_len, void *data)
 {
     struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_GROUP_PEER_NAME, group_number, peer_number,
+                 0, 0, pname, pname_len);
     struct t_twc_chat *chat =
         twc_chat_search_group(profile, group_number, true);
 
-    int npeers, len;
-    struct t_gui_nick *nick = NULL;
-    const char *prev_name;
-    char *name;
-    bool rc;
-    TOX_ERR_CONFERENCE_PEER_QUERY err = TOX_ERR_CONFERENCE_PEER_QUERY_OK;
-
-    struct t_weelist_item *n;
-
-    npeers = tox_conference_peer_count(profile->tox, group_number, &err);
-
-    if (err == TOX_ERR_CONFERENCE_PEER_QUERY_OK)
-    {
-        len = weechat_list_size(chat->nicks);
-        if (len != npeers)
-        {
-            // We missed some events, fallback to full list update
-            twc_group_peer_list_changed_callback(tox, group_number, data);
-            return;
-        }
-    }
-    else
-        return;
-
-    n = weechat_list_get(chat->nicks, peer_number);
-    if (!n)
-    {
-        // We missed some events, fallback to full list update
-        twc_group_peer_list_changed_callback(tox, group_number, data);
-        return;
-    }
-
-    prev_name = weechat_list_string(n);
-    name = twc_null_terminate(pname, pname_len);
-
-    nick = weechat_nicklist_search_nick(chat->buffer, chat->nicklist_group,
-                                        prev_name);
-
-    weechat_nicklist_remove_nick(chat->buffer, nick);
-
-    err = TOX_ERR_CONFERENCE_PEER_QUERY_OK;
-    rc = tox_conference_peer_number_is_ours(tox, group_number, peer_number,
-                                            &err);
-    if ((err == TOX_ERR_CONFERENCE_PEER_QUERY_OK) && (!rc))
-        weechat_printf(chat->buffer, "%s%s is now known as %s",
-                       weechat_prefix("network"), prev_name, name);
-
-    weechat_list_set(n, name);
-
-    weechat_nicklist_add_nick(chat->buffer, chat->nicklist_group, name, NULL,
-                              NULL, NULL, 1);
-
-    free(name);
+    char *name = twc_scratch_null_terminate(pname, pname_len);
+    twc_group_peer_rename(chat, peer_number, name);
 }
 
 void
@@ -579,16 +631,18 @@ twc_group_title_callback(Tox *tox, uint32_t group_number, uint32_t peer_number,
                          const uint8_t *title, size_t length, void *data)
 {
     struct t_twc_profile *profile = data;
+    TWC_CALLBACK(profile, TWC_TRACE_GROUP_TITLE, group_number, peer_number, 0,
+                 0, title, length);
     struct t_twc_chat *chat =
         twc_chat_search_group(profile, group_number, true);
     twc_chat_queue_refresh(chat);
 
-    char *name = twc_get_peer_name_nt(profile->tox, group_number, peer_number);
+    struct t_twc_group_peer *peer = twc_group_peer_get(chat, peer_number);
+    const char *name = peer ? peer->name : "<unknown>";
 
-    char *topic = strndup((char *)title, length);
+    char *topic = twc_scratch_null_terminate(title, length);
     weechat_printf(chat->buffer, "%s%s has changed the topic to \"%s\"",
                    weechat_prefix("network"), name, topic);
-    free(topic);
 }
 
 void
@@ -596,7 +650,9 @@ twc_file_recv_control_callback(Tox *tox, uint32_t friend_number,
                                uint32_t file_number, TOX_FILE_CONTROL control,
                                void *user_data)
 {
-    struct t_twc_profile *profile = twc_profile_search_tox(tox);
+    struct t_twc_profile *profile = user_data;
+    TWC_CALLBACK(profile, TWC_TRACE_FILE_RECV_CONTROL, friend_number,
+                 file_number, control, 0, NULL, 0);
     struct t_twc_tfer_file *file =
         twc_tfer_file_get_by_number(profile->tfer, file_number);
     if (!file)
@@ -637,7 +693,9 @@ twc_file_chunk_request_callback(Tox *tox, uint32_t friend_number,
                                 uint32_t file_number, uint64_t position,
                                 size_t length, void *user_data)
 {
-    struct t_twc_profile *profile = twc_profile_search_tox(tox);
+    struct t_twc_profile *profile = user_data;
+    TWC_CALLBACK(profile, TWC_TRACE_FILE_CHUNK_REQUEST, friend_number,
+                 file_number, length, position, NULL, 0);
     struct t_twc_tfer_file *file =
         twc_tfer_file_get_by_number(profile->tfer, file_number);
     /* the file is missing */
@@ -661,7 +719,9 @@ twc_file_chunk_request_callback(Tox *tox, uint32_t friend_number,
         fclose(file->fp);
         return;
     }
-    uint8_t *data = twc_tfer_file_get_chunk(file, position, length);
+    TWC_SPAN_BEGIN(read_start);
+    uint8_t *data = twc_tfer_file_get_chunk(profile, file, position, length);
+    TWC_SPAN_END(read_start, "tfer", "read_chunk", profile);
     if (!data)
     {
         weechat_printf(profile->buffer, "%serror while reading the file %s",
@@ -677,6 +737,7 @@ twc_file_chunk_request_callback(Tox *tox, uint32_t friend_number,
                        twc_tox_err_file_send_chunk(error));
     else
     {
+        profile->stats->counters.file_bytes_out += length;
         file->position += length;
         file->after_last_cache += length;
         TWC_TFER_FILE_UPDATE_STATUS(TWC_TFER_FILE_STATUS_IN_PROGRESS);
@@ -686,7 +747,7 @@ twc_file_chunk_request_callback(Tox *tox, uint32_t friend_number,
             file->after_last_cache = 0;
         }
     }
-    free(data);
+    twc_memory_free(data);
 }
 
 void
@@ -695,7 +756,9 @@ twc_file_recv_callback(Tox *tox, uint32_t friend_number, uint32_t file_number,
                        const uint8_t *filename, size_t filename_length,
                        void *user_data)
 {
-    struct t_twc_profile *profile = twc_profile_search_tox(tox);
+    struct t_twc_profile *profile = user_data;
+    TWC_CALLBACK(profile, TWC_TRACE_FILE_RECV, friend_number, file_number, kind,
+                 file_size, filename, filename_length);
     if (kind == TOX_FILE_KIND_AVATAR)
     {
         TOX_ERR_FILE_CONTROL error;
@@ -708,13 +771,11 @@ twc_file_recv_callback(Tox *tox, uint32_t friend_number, uint32_t file_number,
         }
         return;
     }
-    char *name = twc_get_name_nt(tox, friend_number);
-    char *fname = twc_null_terminate(filename, filename_length);
+    const char *name = twc_friend_cache_name(profile, friend_number);
+    char *fname = twc_scratch_null_terminate(filename, filename_length);
     struct t_twc_tfer_file *file =
         twc_tfer_file_new(profile, name, fname, friend_number, file_number,
                           file_size, TWC_TFER_FILE_TYPE_DOWNLOADING);
-    free(name);
-    free(fname);
     if (!file)
     {
         weechat_printf(profile->buffer,
@@ -737,7 +798,9 @@ twc_file_recv_chunk_callback(Tox *tox, uint32_t friend_number,
                              const uint8_t *data, size_t length,
                              void *user_data)
 {
-    struct t_twc_profile *profile = twc_profile_search_tox(tox);
+    struct t_twc_profile *profile = user_data;
+    TWC_CALLBACK(profile, TWC_TRACE_FILE_RECV_CHUNK, friend_number, file_number,
+                 0, position, data, length);
     struct t_twc_tfer_file *file =
         twc_tfer_file_get_by_number(profile->tfer, file_number);
     /* the file is missing */
@@ -762,7 +825,9 @@ twc_file_recv_chunk_callback(Tox *tox, uint32_t friend_number,
         fclose(file->fp);
         return;
     }
+    TWC_SPAN_BEGIN(write_start);
     bool result = twc_tfer_file_write_chunk(file, data, position, length);
+    TWC_SPAN_END(write_start, "tfer", "write_chunk", profile);
     if (!result)
     {
         weechat_printf(profile->buffer, "%serror while writing the file %s",
@@ -771,6 +836,7 @@ twc_file_recv_chunk_callback(Tox *tox, uint32_t friend_number,
     }
     else
     {
+        profile->stats->counters.file_bytes_in += length;
         file->position += length;
         file->after_last_cache += length;
         twc_tfer_file_update(profile->tfer, file);
@@ -782,6 +848,72 @@ twc_file_recv_chunk_callback(Tox *tox, uint32_t friend_number,
     }
 }
 
+TWC_TIMED_CALLBACK(twc_friend_message_callback,
+                   (Tox * tox, uint32_t friend_number, TOX_MESSAGE_TYPE type,
+                    const uint8_t *message, size_t length, void *data),
+                   (tox, friend_number, type, message, length, data))
+TWC_TIMED_CALLBACK(twc_connection_status_callback,
+                   (Tox * tox, uint32_t friend_number, TOX_CONNECTION status,
+                    void *data),
+                   (tox, friend_number, status, data))
+TWC_TIMED_CALLBACK(twc_name_change_callback,
+                   (Tox * tox, uint32_t friend_number, const uint8_t *name,
+                    size_t length, void *data),
+                   (tox, friend_number, name, length, data))
+TWC_TIMED_CALLBACK(twc_user_status_callback,
+                   (Tox * tox, uint32_t friend_number, TOX_USER_STATUS status,
+                    void *data),
+                   (tox, friend_number, status, data))
+TWC_TIMED_CALLBACK(twc_status_message_callback,
+                   (Tox * tox, uint32_t friend_number, const uint8_t *message,
+                    size_t length, void *data),
+                   (tox, friend_number, message, length, data))
+TWC_TIMED_CALLBACK(twc_friend_request_callback,
+                   (Tox * tox, const uint8_t *public_key,
+                    const uint8_t *message, size_t length, void *data),
+                   (tox, public_key, message, length, data))
+TWC_TIMED_CALLBACK(twc_group_invite_callback,
+                   (Tox * tox, uint32_t friend_number, TOX_CONFERENCE_TYPE type,
+                    const uint8_t *invite_data, size_t length, void *data),
+                   (tox, friend_number, type, invite_data, length, data))
+TWC_TIMED_CALLBACK(twc_group_message_callback,
+                   (Tox * tox, uint32_t group_number, uint32_t peer_number,
+                    TOX_MESSAGE_TYPE type, const uint8_t *message,
+                    size_t length, void *data),
+                   (tox, group_number, peer_number, type, message, length,
+                    data))
+TWC_TIMED_CALLBACK(twc_group_peer_list_changed_callback,
+                   (Tox * tox, uint32_t group_number, void *data),
+                   (tox, group_number, data))
+TWC_TIMED_CALLBACK(twc_group_peer_name_callback,
+                   (Tox * tox, uint32_t group_number, uint32_t peer_number,
+                    const uint8_t *nick, size_t nick_len, void *data),
+                   (tox, group_number, peer_number, nick, nick_len, data))
+TWC_TIMED_CALLBACK(twc_group_title_callback,
+                   (Tox * tox, uint32_t group_number, uint32_t peer_number,
+                    const uint8_t *title, size_t length, void *data),
+                   (tox, group_number, peer_number, title, length, data))
+TWC_TIMED_CALLBACK(twc_file_recv_control_callback,
+                   (Tox * tox, uint32_t friend_number, uint32_t file_number,
+                    TOX_FILE_CONTROL control, void *data),
+                   (tox, friend_number, file_number, control, data))
+TWC_TIMED_CALLBACK(twc_file_chunk_request_callback,
+                   (Tox * tox, uint32_t friend_number, uint32_t file_number,
+                    uint64_t position, size_t length, void *data),
+                   (tox, friend_number, file_number, position, length, data))
+TWC_TIMED_CALLBACK(twc_file_recv_callback,
+                   (Tox * tox, uint32_t friend_number, uint32_t file_number,
+                    uint32_t kind, uint64_t file_size, const uint8_t *filename,
+                    size_t filename_length, void *data),
+                   (tox, friend_number, file_number, kind, file_size, filename,
+                    filename_length, data))
+TWC_TIMED_CALLBACK(twc_file_recv_chunk_callback,
+                   (Tox * tox, uint32_t friend_number, uint32_t file_number,
+                    uint64_t position, const uint8_t *chunk, size_t length,
+                    void *data),
+                   (tox, friend_number, file_number, position, chunk, length,
+                    data))
+
 #ifndef NDEBUG
 void
 twc_tox_log_callback(Tox *tox, TOX_LOG_LEVEL level, const char *file,
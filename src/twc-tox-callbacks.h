@@ -22,6 +22,8 @@
 
 #include <tox/tox.h>
 
+struct t_twc_profile;
+
 int
 twc_do_timer_cb(const void *pointer, void *data, int remaining_calls);
 
@@ -34,6 +36,9 @@ void
 twc_connection_status_callback(Tox *tox, uint32_t friend_number,
                                TOX_CONNECTION status, void *data);
 
+void
+twc_connection_status_flush(struct t_twc_profile *profile);
+
 void
 twc_name_change_callback(Tox *tox, uint32_t friend_number, const uint8_t *name,
                          size_t length, void *data);
@@ -95,6 +100,83 @@ twc_file_recv_chunk_callback(Tox *tox, uint32_t friend_number,
                              const uint8_t *data, size_t length,
                              void *user_data);
 
+/* timed wrappers around the callbacks above, registered with Tox */
+
+void
+twc_friend_message_callback_timed(Tox *tox, uint32_t friend_number,
+                                  TOX_MESSAGE_TYPE type, const uint8_t *message,
+                                  size_t length, void *data);
+
+void
+twc_connection_status_callback_timed(Tox *tox, uint32_t friend_number,
+                                     TOX_CONNECTION status, void *data);
+
+void
+twc_name_change_callback_timed(Tox *tox, uint32_t friend_number,
+                               const uint8_t *name, size_t length, void *data);
+
+void
+twc_user_status_callback_timed(Tox *tox, uint32_t friend_number,
+                               TOX_USER_STATUS status, void *data);
+
+void
+twc_status_message_callback_timed(Tox *tox, uint32_t friend_number,
+                                  const uint8_t *message, size_t length,
+                                  void *data);
+
+void
+twc_friend_request_callback_timed(Tox *tox, const uint8_t *public_key,
+                                  const uint8_t *message, size_t length,
+                                  void *data);
+
+void
+twc_group_invite_callback_timed(Tox *tox, uint32_t friend_number,
+                                TOX_CONFERENCE_TYPE type,
+                                const uint8_t *invite_data, size_t length,
+                                void *data);
+
+void
+twc_group_message_callback_timed(Tox *tox, uint32_t group_number,
+                                 uint32_t peer_number, TOX_MESSAGE_TYPE type,
+                                 const uint8_t *message, size_t length,
+                                 void *data);
+
+void
+twc_group_peer_list_changed_callback_timed(Tox *tox, uint32_t group_number,
+                                           void *data);
+
+void
+twc_group_peer_name_callback_timed(Tox *tox, uint32_t group_number,
+                                   uint32_t peer_number, const uint8_t *nick,
+                                   size_t nick_len, void *data);
+
+void
+twc_group_title_callback_timed(Tox *tox, uint32_t group_number,
+                               uint32_t peer_number, const uint8_t *title,
+                               size_t length, void *data);
+
+void
+twc_file_recv_control_callback_timed(Tox *tox, uint32_t friend_number,
+                                     uint32_t file_number,
+                                     TOX_FILE_CONTROL control, void *data);
+
+void
+twc_file_chunk_request_callback_timed(Tox *tox, uint32_t friend_number,
+                                      uint32_t file_number, uint64_t position,
+                                      size_t length, void *data);
+
+void
+twc_file_recv_callback_timed(Tox *tox, uint32_t friend_number,
+                             uint32_t file_number, uint32_t kind,
+                             uint64_t file_size, const uint8_t *filename,
+                             size_t filename_length, void *data);
+
+void
+twc_file_recv_chunk_callback_timed(Tox *tox, uint32_t friend_number,
+                                   uint32_t file_number, uint64_t position,
+                                   const uint8_t *chunk, size_t length,
+                                   void *data);
+
 #ifndef NDEBUG
 void
 twc_tox_log_callback(Tox *tox, TOX_LOG_LEVEL level, const char *file,
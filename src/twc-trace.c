@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tox/tox.h>
+#include <weechat/weechat-plugin.h>
+
+#include "twc-chat.h"
+#include "twc-group-peer.h"
+#include "twc-profile.h"
+#include "twc-scratch.h"
+#include "twc-stats.h"
+#include "twc-tox-callbacks.h"
+#include "twc.h"
+
+#include "twc-trace.h"
+
+const char *twc_trace_event_names[TWC_TRACE_NUM_EVENTS] = {
+    [TWC_TRACE_FRIEND_MESSAGE] = "friend_message",
+    [TWC_TRACE_CONNECTION_STATUS] = "connection_status",
+    [TWC_TRACE_NAME] = "name",
+    [TWC_TRACE_USER_STATUS] = "user_status",
+    [TWC_TRACE_STATUS_MESSAGE] = "status_message",
+    [TWC_TRACE_FRIEND_REQUEST] = "friend_request",
+    [TWC_TRACE_GROUP_INVITE] = "group_invite",
+    [TWC_TRACE_GROUP_MESSAGE] = "group_message",
+    [TWC_TRACE_GROUP_PEER_LIST_CHANGED] = "group_peer_list_changed",
+    [TWC_TRACE_GROUP_PEER_NAME] = "group_peer_name",
+    [TWC_TRACE_GROUP_TITLE] = "group_title",
+    [TWC_TRACE_FILE_RECV_CONTROL] = "file_recv_control",
+    [TWC_TRACE_FILE_CHUNK_REQUEST] = "file_chunk_request",
+    [TWC_TRACE_FILE_RECV] = "file_recv",
+    [TWC_TRACE_FILE_RECV_CHUNK] = "file_recv_chunk",
+};
+
+/* true while a recorded callback is being fed to the plugin */
+static bool twc_trace_dispatching = false;
+
+/*
+ * A trace file starts with TWC_TRACE_MAGIC and a 32-bit version, followed by
+ * one record per callback: event type (8 bits), time since the trace was
+ * started in microseconds (64 bits), three 32-bit and one 64-bit argument,
+ * and the length (32 bits) of the data that follows. Numbers are stored in
+ * host byte order; traces are meant to be replayed on the machine that
+ * recorded them.
+ */
+#define TWC_TRACE_MAGIC "TWCTRACE"
+#define TWC_TRACE_VERSION 1
+#define TWC_TRACE_HEADER_SIZE (sizeof(TWC_TRACE_MAGIC) - 1 + 4)
+#define TWC_TRACE_RECORD_SIZE (1 + 8 + 4 * 3 + 8 + 4)
+
+/**
+ * A trace record, as parsed during replay.
+ */
+struct t_twc_trace_record
+{
+    uint8_t event;
+    int64_t time;
+    uint32_t a, b, c;
+    uint64_t d;
+    uint32_t length;
+    const uint8_t *data;
+};
+
+/**
+ * Copy a value into a record buffer, returning the position after it.
+ */
+uint8_t *
+twc_trace_put(uint8_t *position, const void *value, size_t size)
+{
+    memcpy(position, value, size);
+    return position + size;
+}
+
+/**
+ * Copy a value out of a record buffer, returning the position after it.
+ */
+const uint8_t *
+twc_trace_get(const uint8_t *position, void *value, size_t size)
+{
+    memcpy(value, position, size);
+    return position + size;
+}
+
+/**
+ * Expand "%h" in a trace file path. Must be freed.
+ */
+char *
+twc_trace_expand_path(const char *path)
+{
+    const char *weechat_dir = weechat_info_get("weechat_dir", NULL);
+    return weechat_string_replace(path, "%h", weechat_dir);
+}
+
+/**
+ * Append a callback to the profile's trace file. Stops tracing if the file
+ * cannot be written.
+ */
+void
+twc_trace_record(struct t_twc_profile *profile, enum t_twc_trace_event event,
+                 uint32_t a, uint32_t b, uint32_t c, uint64_t d,
+                 const uint8_t *data, size_t length)
+{
+    if (length > UINT32_MAX)
+        length = 0;
+
+    uint8_t header[TWC_TRACE_RECORD_SIZE];
+    uint8_t *position = header;
+    uint8_t event_byte = event;
+    int64_t time = twc_stats_time() - profile->trace_start;
+    uint32_t length32 = length;
+
+    position = twc_trace_put(position, &event_byte, 1);
+    position = twc_trace_put(position, &time, 8);
+    position = twc_trace_put(position, &a, 4);
+    position = twc_trace_put(position, &b, 4);
+    position = twc_trace_put(position, &c, 4);
+    position = twc_trace_put(position, &d, 8);
+    twc_trace_put(position, &length32, 4);
+
+    if (fwrite(header, sizeof(header), 1, profile->trace_file) != 1 ||
+        (length && fwrite(data, length, 1, profile->trace_file) != 1))
+    {
+        weechat_printf(profile->buffer, "%scould not write trace, stopping",
+                       weechat_prefix("error"));
+        twc_trace_stop(profile);
+    }
+}
+
+/**
+ * Start recording the Tox callbacks of a profile to a file, replacing any
+ * trace in progress. Returns false if the file could not be opened.
+ */
+bool
+twc_trace_start(struct t_twc_profile *profile, const char *path)
+{
+    twc_trace_stop(profile);
+
+    char *expanded_path = twc_trace_expand_path(path);
+    if (!expanded_path)
+        return false;
+
+    FILE *file = fopen(expanded_path, "wb");
+    free(expanded_path);
+    if (!file)
+        return false;
+
+    uint32_t version = TWC_TRACE_VERSION;
+    if (fwrite(TWC_TRACE_MAGIC, sizeof(TWC_TRACE_MAGIC) - 1, 1, file) != 1 ||
+        fwrite(&version, sizeof(version), 1, file) != 1)
+    {
+        fclose(file);
+        return false;
+    }
+
+    profile->trace_file = file;
+    profile->trace_start = twc_stats_time();
+
+    return true;
+}
+
+/**
+ * Stop recording a profile's callbacks, if a trace is in progress.
+ */
+void
+twc_trace_stop(struct t_twc_profile *profile)
+{
+    if (!profile->trace_file)
+        return;
+
+    fclose(profile->trace_file);
+    profile->trace_file = NULL;
+}
+
+/**
+ * Parse the record at the current position of a replay. Returns false at
+ * the end of the trace or if the record is truncated.
+ */
+bool
+twc_trace_replay_parse(struct t_twc_trace_replay *replay,
+                       struct t_twc_trace_record *record)
+{
+    if (replay->size - replay->position < TWC_TRACE_RECORD_SIZE)
+        return false;
+
+    const uint8_t *position = replay->data + replay->position;
+    position = twc_trace_get(position, &record->event, 1);
+    position = twc_trace_get(position, &record->time, 8);
+    position = twc_trace_get(position, &record->a, 4);
+    position = twc_trace_get(position, &record->b, 4);
+    position = twc_trace_get(position, &record->c, 4);
+    position = twc_trace_get(position, &record->d, 8);
+    position = twc_trace_get(position, &record->length, 4);
+
+    if (replay->size - replay->position - TWC_TRACE_RECORD_SIZE <
+        record->length)
+        return false;
+
+    record->data = position;
+    return true;
+}
+
+/**
+ * Line hook tagging everything printed by a replayed callback with no_log,
+ * so that replays do not end up in the profile's logs.
+ */
+struct t_hashtable *
+twc_trace_replay_line_cb(const void *pointer, void *data,
+                         struct t_hashtable *line)
+{
+    if (!twc_trace_dispatching)
+        return NULL;
+
+    struct t_hashtable *result = weechat_hashtable_new(
+        8, WEECHAT_HASHTABLE_STRING, WEECHAT_HASHTABLE_STRING, NULL, NULL);
+    if (!result)
+        return NULL;
+
+    const char *tags = weechat_hashtable_get(line, "tags");
+    char new_tags[1024];
+    snprintf(new_tags, sizeof(new_tags), "%s%sno_log,tox_replay",
+             tags ? tags : "", tags && tags[0] ? "," : "");
+    weechat_hashtable_set(result, "tags", new_tags);
+
+    return result;
+}
+
+/**
+ * Check if a recorded callback can be replayed without changing the state of
+ * the profile. Only messages are replayed, and only into chats that are
+ * already open and from group peers that are already known; every other
+ * callback updates friends, nicklists, message queues, requests, invites or
+ * file transfers of the live profile.
+ */
+bool
+twc_trace_replay_safe(struct t_twc_profile *profile,
+                      struct t_twc_trace_record *record)
+{
+    struct t_twc_chat *chat;
+    switch (record->event)
+    {
+        case TWC_TRACE_FRIEND_MESSAGE:
+            return twc_chat_search_friend(profile, record->a, false) != NULL;
+        case TWC_TRACE_GROUP_MESSAGE:
+            chat = twc_chat_search_group(profile, record->a, false);
+            return chat && twc_group_peer_get(chat, record->b);
+        default:
+            return false;
+    }
+}
+
+/**
+ * Feed a recorded callback to the plugin's Tox callbacks, timed like live
+ * ones.
+ */
+void
+twc_trace_dispatch(struct t_twc_profile *profile,
+                   struct t_twc_trace_record *record)
+{
+    Tox *tox = profile->tox;
+    const uint8_t *data = record->data;
+    size_t length = record->length;
+
+    switch (record->event)
+    {
+        case TWC_TRACE_FRIEND_MESSAGE:
+            twc_friend_message_callback_timed(tox, record->a, record->b, data,
+                                              length, profile);
+            break;
+        case TWC_TRACE_CONNECTION_STATUS:
+            twc_connection_status_callback_timed(tox, record->a, record->b,
+                                                 profile);
+            break;
+        case TWC_TRACE_NAME:
+            twc_name_change_callback_timed(tox, record->a, data, length,
+                                           profile);
+            break;
+        case TWC_TRACE_USER_STATUS:
+            twc_user_status_callback_timed(tox, record->a, record->b, profile);
+            break;
+        case TWC_TRACE_STATUS_MESSAGE:
+            twc_status_message_callback_timed(tox, record->a, data, length,
+                                              profile);
+            break;
+        case TWC_TRACE_FRIEND_REQUEST:
+            if (length >= TOX_PUBLIC_KEY_SIZE)
+            {
+                twc_friend_request_callback_timed(tox, data,
+                                                  data + TOX_PUBLIC_KEY_SIZE,
+                                                  length - TOX_PUBLIC_KEY_SIZE,
+                                                  profile);
+            }
+            break;
+        case TWC_TRACE_GROUP_INVITE:
+            twc_group_invite_callback_timed(tox, record->a, record->b, data,
+                                            length, profile);
+            break;
+        case TWC_TRACE_GROUP_MESSAGE:
+            twc_group_message_callback_timed(tox, record->a, record->b,
+                                             record->c, data, length, profile);
+            break;
+        case TWC_TRACE_GROUP_PEER_LIST_CHANGED:
+            twc_group_peer_list_changed_callback_timed(tox, record->a,
+                                                       profile);
+            break;
+        case TWC_TRACE_GROUP_PEER_NAME:
+            twc_group_peer_name_callback_timed(tox, record->a, record->b, data,
+                                               length, profile);
+            break;
+        case TWC_TRACE_GROUP_TITLE:
+            twc_group_title_callback_timed(tox, record->a, record->b, data,
+                                           length, profile);
+            break;
+        case TWC_TRACE_FILE_RECV_CONTROL:
+            twc_file_recv_control_callback_timed(tox, record->a, record->b,
+                                                 record->c, profile);
+            break;
+        case TWC_TRACE_FILE_CHUNK_REQUEST:
+            twc_file_chunk_request_callback_timed(tox, record->a, record->b,
+                                                  record->d, record->c,
+                                                  profile);
+            break;
+        case TWC_TRACE_FILE_RECV:
+            twc_file_recv_callback_timed(tox, record->a, record->b, record->c,
+                                         record->d, data, length, profile);
+            break;
+        case TWC_TRACE_FILE_RECV_CHUNK:
+            twc_file_recv_chunk_callback_timed(tox, record->a, record->b,
+                                               record->d, data, length,
+                                               profile);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Replay the records of a trace that are due, i.e. all of them for a fast
+ * replay. Returns false when the trace is exhausted.
+ */
+bool
+twc_trace_replay_step(struct t_twc_trace_replay *replay, int64_t *next_time)
+{
+    struct t_twc_profile *profile = replay->profile;
+    int64_t elapsed = twc_stats_time() - replay->start;
+
+    struct t_twc_trace_record record;
+    bool more;
+    while ((more = twc_trace_replay_parse(replay, &record)))
+    {
+        if (!replay->fast && record.time > elapsed)
+        {
+            *next_time = record.time;
+            break;
+        }
+
+        if (!twc_trace_replay_safe(profile, &record))
+        {
+            ++replay->skipped;
+        }
+        else
+        {
+            /* count the replay in its own statistics, not the profile's */
+            struct t_twc_stats *stats = profile->stats;
+            profile->stats = replay->stats;
+            twc_trace_dispatching = true;
+            twc_trace_dispatch(profile, &record);
+            twc_trace_dispatching = false;
+            profile->stats = stats;
+        }
+        replay->position += TWC_TRACE_RECORD_SIZE + record.length;
+        ++replay->events;
+    }
+
+    /* do what twc_do_timer_cb does after tox_iterate */
+    twc_connection_status_flush(profile);
+    twc_scratch_reset();
+
+    return more;
+}
+
+/**
+ * Print the outcome of a replay and free it.
+ */
+void
+twc_trace_replay_finish(struct t_twc_trace_replay *replay)
+{
+    struct t_twc_profile *profile = replay->profile;
+    int64_t elapsed = twc_stats_time() - replay->start;
+
+    weechat_printf(profile->buffer,
+                   "%sreplayed %" PRIu64 " events in %" PRId64 ".%03" PRId64
+                   " ms (%" PRIu64 " events that would change the profile "
+                   "skipped)",
+                   weechat_prefix("network"), replay->events - replay->skipped,
+                   elapsed / 1000, elapsed % 1000, replay->skipped);
+    if (replay->position != replay->size)
+    {
+        weechat_printf(profile->buffer, "%strace is truncated or corrupt",
+                       weechat_prefix("error"));
+    }
+    twc_stats_print_counters(replay->stats, profile->buffer);
+
+    if (replay->line_hook)
+        weechat_unhook(replay->line_hook);
+    profile->trace_replay = NULL;
+    twc_stats_free(replay->stats);
+    free(replay->data);
+    free(replay);
+}
+
+/**
+ * Timer callback replaying a trace at recorded speed.
+ */
+int
+twc_trace_replay_timer_cb(const void *pointer, void *data,
+                          int remaining_calls)
+{
+    struct t_twc_trace_replay *replay = (void *)pointer;
+    replay->timer = NULL;
+
+    int64_t next_time = 0;
+    if (!twc_trace_replay_step(replay, &next_time))
+    {
+        twc_trace_replay_finish(replay);
+        return WEECHAT_RC_OK;
+    }
+
+    int64_t delay = (next_time - (twc_stats_time() - replay->start)) / 1000;
+    replay->timer = weechat_hook_timer(delay > 0 ? delay : 1, 0, 1,
+                                       twc_trace_replay_timer_cb, replay, NULL);
+    if (!replay->timer)
+        twc_trace_replay_finish(replay);
+
+    return WEECHAT_RC_OK;
+}
+
+/**
+ * Read a trace file into memory. Returns NULL on failure.
+ */
+uint8_t *
+twc_trace_read(const char *path, size_t *size)
+{
+    char *expanded_path = twc_trace_expand_path(path);
+    if (!expanded_path)
+        return NULL;
+
+    FILE *file = fopen(expanded_path, "rb");
+    free(expanded_path);
+    if (!file)
+        return NULL;
+
+    uint8_t *data = NULL;
+    long length;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 &&
+        fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length + 1)) &&
+        fread(data, 1, length, file) == (size_t)length)
+    {
+        *size = length;
+    }
+    else
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    return data;
+}
+
+/**
+ * Replay a trace file into a loaded profile, either at recorded speed or as
+ * fast as possible. Output of replayed callbacks is tagged no_log, events
+ * that would change the profile are skipped (see twc_trace_replay_safe) and
+ * the replay is counted in its own statistics. Returns false if the file
+ * cannot be read or is not a trace, or if the profile is recording a trace.
+ */
+bool
+twc_trace_replay(struct t_twc_profile *profile, const char *path, bool fast)
+{
+    if (profile->trace_file)
+        return false;
+
+    twc_trace_replay_cancel(profile);
+
+    size_t size;
+    uint8_t *data = twc_trace_read(path, &size);
+    if (!data)
+        return false;
+
+    uint32_t version = 0;
+    if (size >= TWC_TRACE_HEADER_SIZE)
+        twc_trace_get(data + sizeof(TWC_TRACE_MAGIC) - 1, &version, 4);
+    if (size < TWC_TRACE_HEADER_SIZE ||
+        memcmp(data, TWC_TRACE_MAGIC, sizeof(TWC_TRACE_MAGIC) - 1) != 0 ||
+        version != TWC_TRACE_VERSION)
+    {
+        free(data);
+        return false;
+    }
+
+    struct t_twc_trace_replay *replay =
+        calloc(1, sizeof(struct t_twc_trace_replay));
+    if (replay)
+        replay->stats = twc_stats_new();
+    if (!replay || !replay->stats)
+    {
+        free(replay);
+        free(data);
+        return false;
+    }
+
+    replay->profile = profile;
+    replay->data = data;
+    replay->size = size;
+    replay->position = TWC_TRACE_HEADER_SIZE;
+    replay->fast = fast;
+    replay->start = twc_stats_time();
+    replay->line_hook = weechat_hook_line("formatted", "*", NULL,
+                                          twc_trace_replay_line_cb, NULL, NULL);
+    profile->trace_replay = replay;
+
+    if (fast)
+    {
+        int64_t next_time;
+        twc_trace_replay_step(replay, &next_time);
+        twc_trace_replay_finish(replay);
+    }
+    else
+    {
+        twc_trace_replay_timer_cb(replay, NULL, 0);
+    }
+
+    return true;
+}
+
+/**
+ * Stop a replay in progress for a profile, if any.
+ */
+void
+twc_trace_replay_cancel(struct t_twc_profile *profile)
+{
+    struct t_twc_trace_replay *replay = profile->trace_replay;
+    if (!replay)
+        return;
+
+    if (replay->timer)
+        weechat_unhook(replay->timer);
+    if (replay->line_hook)
+        weechat_unhook(replay->line_hook);
+    profile->trace_replay = NULL;
+    twc_stats_free(replay->stats);
+    free(replay->data);
+    free(replay);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2018 Håvard Pettersson <mail@haavard.me>
+ *
+ * This file is part of Tox-WeeChat.
+ *
+ * Tox-WeeChat is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox-WeeChat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox-WeeChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOX_WEECHAT_TRACE_H
+#define TOX_WEECHAT_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct t_twc_profile;
+struct t_twc_stats;
+struct t_hook;
+
+/**
+ * Tox callbacks that can be recorded in a trace.
+ */
+enum t_twc_trace_event
+{
+    TWC_TRACE_FRIEND_MESSAGE = 1,
+    TWC_TRACE_CONNECTION_STATUS,
+    TWC_TRACE_NAME,
+    TWC_TRACE_USER_STATUS,
+    TWC_TRACE_STATUS_MESSAGE,
+    TWC_TRACE_FRIEND_REQUEST,
+    TWC_TRACE_GROUP_INVITE,
+    TWC_TRACE_GROUP_MESSAGE,
+    TWC_TRACE_GROUP_PEER_LIST_CHANGED,
+    TWC_TRACE_GROUP_PEER_NAME,
+    TWC_TRACE_GROUP_TITLE,
+    TWC_TRACE_FILE_RECV_CONTROL,
+    TWC_TRACE_FILE_CHUNK_REQUEST,
+    TWC_TRACE_FILE_RECV,
+    TWC_TRACE_FILE_RECV_CHUNK,
+
+    TWC_TRACE_NUM_EVENTS,
+};
+
+/* names of the events, for statistics and reports */
+extern const char *twc_trace_event_names[TWC_TRACE_NUM_EVENTS];
+
+/**
+ * A trace being replayed into a profile.
+ */
+struct t_twc_trace_replay
+{
+    struct t_twc_profile *profile;
+    uint8_t *data;
+    size_t size;
+    size_t position;
+
+    /* replay as fast as possible instead of at recorded speed */
+    bool fast;
+    int64_t start;
+    uint64_t events;
+    uint64_t skipped;
+    /* statistics of the replayed callbacks, kept apart from the profile's */
+    struct t_twc_stats *stats;
+    struct t_hook *timer;
+    struct t_hook *line_hook;
+};
+
+void
+twc_trace_record(struct t_twc_profile *profile, enum t_twc_trace_event event,
+                 uint32_t a, uint32_t b, uint32_t c, uint64_t d,
+                 const uint8_t *data, size_t length);
+
+bool
+twc_trace_start(struct t_twc_profile *profile, const char *path);
+
+void
+twc_trace_stop(struct t_twc_profile *profile);
+
+bool
+twc_trace_replay(struct t_twc_profile *profile, const char *path, bool fast);
+
+void
+twc_trace_replay_cancel(struct t_twc_profile *profile);
+
+#endif /* TOX_WEECHAT_TRACE_H */
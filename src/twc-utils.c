@@ -28,40 +28,79 @@
 
 #include "twc-utils.h"
 
+/* hex digit values plus one, so that zero marks an invalid character */
+static const uint8_t twc_hex_values[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,  ['5'] = 6,
+    ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10, ['A'] = 11, ['B'] = 12,
+    ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16, ['a'] = 11, ['b'] = 12,
+    ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+static const char twc_hex_digits[] = "0123456789ABCDEF";
+
 /**
- * Convert a hex string to it's binary equivalent of max size bytes.
+ * Convert the first size * 2 characters of a hex string to size bytes.
+ * Returns false if any of them is not a hex digit, in which case out is left
+ * partially written.
  */
-void
+bool
 twc_hex2bin(const char *hex, size_t size, uint8_t *out)
 {
-    const char *position = hex;
+    const unsigned char *position = (const unsigned char *)hex;
 
-    size_t i;
-    for (i = 0; i < size; ++i)
+    for (size_t i = 0; i < size; ++i)
     {
-        sscanf(position, "%2hhx", &out[i]);
+        uint8_t high = twc_hex_values[position[0]];
+        if (!high)
+            return false;
+        uint8_t low = twc_hex_values[position[1]];
+        if (!low)
+            return false;
+
+        out[i] = (high - 1) << 4 | (low - 1);
         position += 2;
     }
+
+    return true;
 }
 
 /**
- * Convert size bytes to a hex string. out must be at lesat size * 2 + 1
- * bytes.
+ * Convert size bytes to an upper case hex string. out must be at least
+ * size * 2 + 1 bytes.
  */
 void
 twc_bin2hex(const uint8_t *bin, size_t size, char *out)
 {
     char *position = out;
 
-    size_t i;
-    for (i = 0; i < size; ++i)
+    for (size_t i = 0; i < size; ++i)
     {
-        sprintf(position, "%02X", bin[i]);
-        position += 2;
+        *position++ = twc_hex_digits[bin[i] >> 4];
+        *position++ = twc_hex_digits[bin[i] & 0xF];
     }
     *position = 0;
 }
 
+/**
+ * Copy a string, folding ASCII letters to lower case, for case insensitive
+ * hashtable keys. Must be freed.
+ */
+char *
+twc_fold_case(const char *string)
+{
+    char *folded = strdup(string);
+    if (folded)
+    {
+        for (char *c = folded; *c; ++c)
+        {
+            if (*c >= 'A' && *c <= 'Z')
+                *c += 'a' - 'A';
+        }
+    }
+
+    return folded;
+}
+
 /**
  * Return a null-terminated copy of str. Must be freed.
  */
@@ -136,10 +175,10 @@ twc_get_peer_name_nt(Tox *tox, int32_t group_number, int32_t peer_number)
         if (err == TOX_ERR_CONFERENCE_PEER_QUERY_OK)
             return twc_null_terminate(name, length);
         else
-            return "<unknown>";
+            return strdup("<unknown>");
     }
     else
-        return "<unknown>";
+        return strdup("<unknown>");
 }
 
 /**
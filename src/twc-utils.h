@@ -20,17 +20,21 @@
 #ifndef TOX_WEECHAT_UTILS_H
 #define TOX_WEECHAT_UTILS_H
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include <tox/tox.h>
 #include <weechat/weechat-plugin.h>
 
-void
+bool
 twc_hex2bin(const char *hex, size_t size, uint8_t *out);
 
 void
 twc_bin2hex(const uint8_t *bin, size_t size, char *out);
 
+char *
+twc_fold_case(const char *string);
+
 char *
 twc_null_terminate(const uint8_t *str, size_t length);
 
@@ -18,14 +18,22 @@
  */
 
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <weechat/weechat-plugin.h>
 
+#include "twc-bootstrap.h"
 #include "twc-commands.h"
 #include "twc-completion.h"
 #include "twc-config.h"
 #include "twc-gui.h"
+#include "twc-memory.h"
+#include "twc-metrics.h"
 #include "twc-profile.h"
+#include "twc-scratch.h"
+#include "twc-span.h"
+#include "twc-stats.h"
 
 #include "twc.h"
 
@@ -46,9 +54,21 @@ weechat_plugin_init(struct t_weechat_plugin *plugin, int argc, char *argv[])
     twc_commands_init();
     twc_gui_init();
     twc_completion_init();
+    twc_stats_init();
 
     twc_config_init();
     twc_config_read();
+    twc_metrics_reload();
+
+    /* seed the random picking of bootstrap nodes */
+    srand(time(NULL) ^ getpid());
+    if (twc_bootstrap_reload() < 0)
+    {
+        weechat_printf(NULL,
+                       "%s%s: could not parse bootstrap node file, using "
+                       "built-in nodes",
+                       weechat_prefix("error"), weechat_plugin->name);
+    }
 
     bool no_autoconnect = false;
     for (int i = 0; i < argc; i++)
@@ -70,7 +90,12 @@ weechat_plugin_end(struct t_weechat_plugin *plugin)
 {
     twc_config_write();
 
+    twc_metrics_free();
     twc_profile_free_all();
+    twc_bootstrap_free();
+    twc_scratch_free();
+    twc_span_free();
+    twc_memory_free_all();
 
     return WEECHAT_RC_OK;
 }